@@ -24,6 +24,10 @@
       +-7-+-6-+-5-+-4-+-3-+-2-+-1-+-0-+
       | 0 | 0 | 0 | 0 | 0 | 0 | 1 | 0 |
       +---+---+---+---+---+---+---+---+
+   SLAY2_END_OF_CDATA (0x3) - DATA frame with compressed payload (see slay2_compression.h). Its CRC is inverted.
+      +-7-+-6-+-5-+-4-+-3-+-2-+-1-+-0-+
+      | 0 | 0 | 0 | 0 | 0 | 0 | 1 | 1 |
+      +---+---+---+---+---+---+---+---+
 
 
    DATA is encoded into a byte stream. Each byte of DATA stream contains
@@ -56,7 +60,8 @@
    Assembly of DATA frames:
      -- 1st byte: sequence number of the frame
      -- 2nd byte: communication hannel number
-     -- next-N bytes: Up to 256 payload data bytes (sent through the communication channel)
+     -- next-N bytes: Up to 256 payload data bytes (sent through the communication channel). up to 4096 bytes, if
+        large frames were negotiated (see HELLO frames)
      -- final 4 bytes: 32-bit CRC of the entire frame (big endian)
 
 
@@ -70,14 +75,54 @@
      -- final 4 bytes: 32-bit CRC of the entire frame (big endian)
 
 
+   CUMULATIVE-ACK-FRAME
+      +------+-----+--------------+-------+
+      | 0x01 | SEQ |    BITMAP    | CRC32 |
+      +------+-----+--------------+-------+
+
+   Assembly of cumulative ACK frames:
+     -- 1st byte: type (0x01)
+     -- 2nd byte: sequence number. all frames up to (and including) this one were received
+     -- next-N bytes: 0..16 bytes bitmap. bit[i] (bit i%8 of byte i/8) set, if frame SEQ+2+i was received (out of order)
+     -- final 4 bytes: 32-bit CRC of the entire frame (big endian)
+
+
+   NAK-FRAME
+      +------+-----+-------+
+      | 0x02 | SEQ | CRC32 |
+      +------+-----+-------+
+
+   Assembly of NAK frames (transmitted on the ACK stream):
+     -- 1st byte: type (0x02)
+     -- 2nd byte: sequence number of the missing frame. all frames before this one were received
+     -- final 4 bytes: 32-bit CRC of the entire frame (big endian)
+
+
+   HELLO-FRAME
+      +------+-------------+-------+
+      | 0x03 | MAX PAYLOAD | CRC32 |
+      +------+-------------+-------+
+
+   Assembly of HELLO frames (transmitted on the ACK stream, after the SYNC sequence):
+     -- 1st byte: type (0x03)
+     -- next 2 bytes: max. payload of the DATA frames, the sender is able to receive (big endian)
+     -- final 4 bytes: 32-bit CRC of the entire frame (big endian)
+   HELLO frames are sent only, if large frames are enabled (setMaxFramePayload). after a SYNC, both endpoints use
+   DATA frames with up to 256 bytes, until the HELLO frame of the remote endpoint was received. older endpoints
+   ignore it, so they keep the default frame format.
+   ACK frames with a length of more than 5 bytes, are identified by their type byte.
+
+
     Note:
     For transmission, these frames are encoded and terminated with an end-of-ack resp. end-of-data byte.
+    Frames are never interleaved. So the end of any frame also terminates a (corrupted) frame of the other type.
 
 */
 //-----------------------------------------------------------------------------
 
 /* -- Includes ------------------------------------------------------------ */
 #include <iostream>
+#include <new>
 #include "slay2.h"
 
 
@@ -96,16 +141,33 @@ using namespace std;
 
 /* -- Implementation ------------------------------------------------------ */
 
-Slay2::Slay2()
+Slay2::Slay2(const unsigned int windowSize) : txScheduler(&pool, &stats, windowSize), rxReorder(&pool)
 {
    for (unsigned int channel = 0; channel < SLAY2_NUM_CHANNELS; ++channel)
    {
       this->channels[channel] = NULL;
+      this->decompressors[channel] = NULL;
+   }
+   for (unsigned int word = 0; word < ((SLAY2_NUM_CHANNELS + 31) / 32); ++word)
+   {
+      sentChannels[word] = 0;
    }
    syncSent = false;
    syncCount = 0;
    nextExpRxSeqNr = 0;
+   selectiveRepeat = false;
+   cumulativeAck = false;
+   negativeAck = false;
+   nakSent = false;
    verbose = false;
+   rxFrameBuffer = NULL;
+   maxFramePayload = SLAY2_FRAME_PAYLOAD;
+   txPending = NULL;
+   txPendingOffset = 0;
+   deliveryByTask = false;
+   delivering = false;
+   inTask = false;
+   memset(&stats, 0, sizeof(stats));
 }
 
 
@@ -117,16 +179,24 @@ Slay2::~Slay2()
       Slay2Channel * const ch = this->channels[channel];
       if (ch != NULL)
       {
-         this->channels[channel] = NULL;
-         delete ch;
+         release(ch); //without critical section: the derived class is already destructed
+      }
+      if (decompressors[channel] != NULL)
+      {
+         decompressors[channel]->~Slay2Decompressor();
+         pool.release(decompressors[channel]);
+         decompressors[channel] = NULL;
       }
    }
+   pool.release(rxFrameBuffer);
+   pool.release(rxDelivery.getBuffer()); //undelivered data is dropped
 }
 
 
 void Slay2::task(void)
 {
    enterCritical();
+   inTask = true;
    //on startup
    if (syncSent == false)
    {
@@ -134,16 +204,37 @@ void Slay2::task(void)
       if (verbose) cout << "SLAY2: Sending 5x SYNC" << endl;
       if (transmit(syncSequence, 5) >= 5) //send 5 sync chars to get in synchronisation with the remote endpoint
       {
-         txScheduler.reset();
-         rxAckDecoder.flush();
-         rxDataDecoder.flush();
-         nextExpRxSeqNr = 0;
+         reset();
          syncSent = true;
       }
    }
-   doReception();
-   doTransmission();
+   const unsigned int time1ms = getTime1ms();
+   const unsigned int start1us = getTime1us();
+   collectSent();
+   doReception(time1ms);
+   const unsigned int rx1us = getTime1us();
+   doTransmission(time1ms);
+   const unsigned int tx1us = getTime1us();
+   //statistics: time spent in reception (incl. the receivers) and transmission
+   ++stats.taskCount;
+   stats.rxTimeSum += rx1us - start1us;
+   stats.txTimeSum += tx1us - rx1us;
+   if (stats.rxTimeMax < (rx1us - start1us))
+   {
+      stats.rxTimeMax = rx1us - start1us;
+   }
+   if (stats.txTimeMax < (tx1us - rx1us))
+   {
+      stats.txTimeMax = tx1us - rx1us;
+   }
+   const bool deliver = deliveryByTask && (rxDelivery.getBuffer() != NULL);
+   inTask = false;
    leaveCritical();
+   //deferred delivery: the receivers are called outside the critical section
+   if (deliver)
+   {
+      deliverQueued();
+   }
 }
 
 
@@ -153,133 +244,839 @@ void Slay2::setVerbose(void)
 }
 
 
-void Slay2::doReception(void)
+bool Slay2::setWindowSize(const unsigned int windowSize)
+{
+   bool success;
+   enterCritical();
+   success = txScheduler.setWindowSize(windowSize);
+   if (success && selectiveRepeat)
+   {
+      //the receiver keeps up to one window of frames out of order
+      success = rxReorder.setSize(windowSize, SLAY2_RX_BUFFER_SIZE(maxFramePayload));
+   }
+   if (success)
+   {
+      txPending = NULL;
+      syncSent = false; //frames in flight are dropped -> re-synchronize with the remote endpoint
+   }
+   leaveCritical();
+   return success;
+}
+
+
+unsigned int Slay2::getWindowSize(void)
+{
+   return txScheduler.getWindowSize();
+}
+
+
+bool Slay2::setSelectiveRepeat(const bool enable)
+{
+   bool success;
+   enterCritical();
+   success = rxReorder.setSize(enable ? txScheduler.getWindowSize() : 0, SLAY2_RX_BUFFER_SIZE(maxFramePayload));
+   selectiveRepeat = enable && success;
+   txScheduler.setSelectiveRepeat(selectiveRepeat);
+   syncSent = false; //re-synchronize with the remote endpoint
+   leaveCritical();
+   return success;
+}
+
+
+void Slay2::setCumulativeAck(const bool enable, const unsigned int delay1ms)
+{
+   enterCritical();
+   cumulativeAck = enable;
+   txScheduler.setAckDelay(delay1ms);
+   leaveCritical();
+}
+
+
+void Slay2::setNegativeAck(const bool enable)
+{
+   enterCritical();
+   negativeAck = enable;
+   leaveCritical();
+}
+
+
+bool Slay2::setMaxFramePayload(const unsigned int maxPayload)
+{
+   if ((maxPayload < SLAY2_FRAME_PAYLOAD) || (maxPayload > SLAY2_MAX_FRAME_PAYLOAD))
+   {
+      return false;
+   }
+   enterCritical();
+   //large frames are decoded into a buffer of the pool. default frames use the own buffer of the decoder
+   unsigned char * const buffer = (maxPayload > SLAY2_FRAME_PAYLOAD) ? (unsigned char *)pool.alloc(SLAY2_RX_BUFFER_SIZE(maxPayload)) : NULL;
+   //larger RX rings are kept, if a later step fails (they are not too small for the previous frame size)
+   bool success = ((buffer != NULL) || (maxPayload == SLAY2_FRAME_PAYLOAD)) && growRxRings(maxPayload) &&
+                  txScheduler.setMaxFramePayload(maxPayload);
+   if (success && selectiveRepeat)
+   {
+      success = rxReorder.setSize(txScheduler.getWindowSize(), SLAY2_RX_BUFFER_SIZE(maxPayload));
+      if (success == false)
+      {
+         //pool exhausted -> keep the previous frame size
+         rxReorder.setSize(txScheduler.getWindowSize(), SLAY2_RX_BUFFER_SIZE(maxFramePayload));
+         txScheduler.setMaxFramePayload(maxFramePayload);
+      }
+   }
+   if (success)
+   {
+      rxDataDecoder.setBuffer(buffer, SLAY2_RX_BUFFER_SIZE(maxPayload));
+      pool.release(rxFrameBuffer);
+      rxFrameBuffer = buffer;
+      maxFramePayload = maxPayload;
+   }
+   else
+   {
+      pool.release(buffer);
+   }
+   txPending = NULL;
+   syncSent = false; //frames in flight are dropped -> re-synchronize (and negotiate) with the remote endpoint
+   leaveCritical();
+   return success;
+}
+
+
+//the RX ring of a channel must keep any payload (a frame is delivered at once)
+unsigned int Slay2::getRxRingSize(const unsigned int rxBufferSize, const unsigned int maxPayload)
+{
+   const unsigned int size = (rxBufferSize > maxPayload) ? rxBufferSize : maxPayload;
+   return Slay2Pool::getBlockSize((size > SLAY2_LZ_INPUT) ? size : SLAY2_LZ_INPUT);
+}
+
+
+//reallocate the RX rings of the open channels, which are smaller than "maxPayload". the received data is kept.
+//all or nothing: returns false (the rings are unchanged), if the pool is exhausted
+bool Slay2::growRxRings(const unsigned int maxPayload)
+{
+   unsigned char * rings[SLAY2_NUM_CHANNELS];
+   const unsigned int size = getRxRingSize(0, maxPayload);
+   bool success = true;
+   for (unsigned int i = 0; i < SLAY2_NUM_CHANNELS; ++i)
+   {
+      Slay2Channel * const ch = channels[i];
+      const bool grow = (ch != NULL) && (ch->rxFifo.getBuffer() != NULL) && (ch->rxFifo.getSize() < size);
+      rings[i] = grow ? (unsigned char *)pool.alloc(size) : NULL;
+      success = success && ((rings[i] != NULL) || (grow == false));
+   }
+   for (unsigned int i = 0; i < SLAY2_NUM_CHANNELS; ++i)
+   {
+      if (success && (rings[i] != NULL))
+      {
+         Slay2Fifo * const rxFifo = &channels[i]->rxFifo;
+         unsigned char * const previous = rxFifo->getBuffer();
+         const unsigned char * seg[2];
+         unsigned int segLen[2];
+         rxFifo->peek(seg, segLen, rxFifo->getCount());
+         rxFifo->setBuffer(rings[i], size);
+         rxFifo->pushN(seg[0], segLen[0]); //copy the data out of the previous ring, before it is released
+         rxFifo->pushN(seg[1], segLen[1]);
+         pool.release(previous);
+      }
+      else
+      {
+         pool.release(rings[i]);
+      }
+   }
+   return success;
+}
+
+
+//blocking calls (read, flushAndWait) within the critical section: wait for received data resp. acknowledges. without
+//another thread, that calls task(), the protocol is run by the waiting caller. returns false, if it can't wait
+bool Slay2::waitEvent(const unsigned int timeout1ms)
+{
+   if (hasTaskThread())
+   {
+      return waitReceived(timeout1ms);
+   }
+   if (inTask)
+   {
+      return false; //called by a receiver: task() must not be run recursively
+   }
+   task();
+   waitReceived((timeout1ms < SLAY2_WAIT_POLL) ? timeout1ms : SLAY2_WAIT_POLL); //a pause, if the target is able to wait
+   return true;
+}
+
+
+unsigned int Slay2::getFramePayload(void)
+{
+   enterCritical();
+   const unsigned int payload = txScheduler.getFramePayload();
+   leaveCritical();
+   return payload;
+}
+
+
+//max. payload of new data frames. channels, which wait for a complete frame, may be ready now (or not anymore)
+void Slay2::setFramePayload(const unsigned int payload)
+{
+   txScheduler.setFramePayload(payload);
+   for (unsigned int channel = 0; channel < SLAY2_NUM_CHANNELS; ++channel)
+   {
+      if (channels[channel] != NULL)
+      {
+         txScheduler.updateReady(channels[channel]);
+      }
+   }
+}
+
+
+//baudrate of the serial line. the retransmission timeout is scaled by the transmission time of the frames
+void Slay2::setBaudrate(const unsigned int baudrate)
 {
-   unsigned char rxBuffer;
-   while (this->receive(&rxBuffer, 1) > 0)
+   enterCritical();
+   txScheduler.setBaudrate(baudrate);
+   leaveCritical();
+}
+
+
+unsigned int Slay2::getRto(void)
+{
+   enterCritical();
+   const unsigned int rto = txScheduler.getRto();
+   leaveCritical();
+   return rto;
+}
+
+
+//reset the state of transmitter and receiver. used for synchronisation with the remote endpoint
+void Slay2::reset(void)
+{
+   txScheduler.reset();
+   rxAckDecoder.flush();
+   rxDataDecoder.flush();
+   rxReorder.flush();
+   nextExpRxSeqNr = 0;
+   nakSent = false;
+   txPending = NULL; //a partially transmitted frame is dropped
+   notifyReceived(); //the frames of the window are dropped -> wake up flushAndWait()
+   //the remote endpoint (re-)starts with default frames. it announces large frames by its HELLO frame (after its SYNC)
+   setFramePayload(SLAY2_FRAME_PAYLOAD);
+   if (maxFramePayload > SLAY2_FRAME_PAYLOAD)
    {
-      //SYN
-      if (rxBuffer == SLAY2_SYNC)
+      txScheduler.scheduleHello(maxFramePayload);
+   }
+   //frames in flight are dropped -> the next compressed frames reset the dictionaries of the remote endpoint
+   for (unsigned int channel = 0; channel < SLAY2_NUM_CHANNELS; ++channel)
+   {
+      if ((channels[channel] != NULL) && (channels[channel]->compressor != NULL))
+      {
+         channels[channel]->compressor->reset();
+      }
+   }
+}
+
+
+//event-driven operation: task() has nothing to do for the returned time [ms], unless new data is sent (see notify())
+//or received. then the task may sleep.
+unsigned int Slay2::getIdleTime(void)
+{
+   unsigned int idle = 0;
+   enterCritical();
+   if (syncSent)
+   {
+      collectSent();
+      idle = (txPending != NULL) ? 0 : txScheduler.getIdleTime(getTime1ms());
+      const unsigned int txCount = getTxCount();
+      const unsigned int threshold = txScheduler.getTxThreshold();
+      if ((idle == 0) && (txCount > threshold))
       {
-         ++syncCount;
-         if (verbose) cout << "SLAY2: SYNC received" << endl;
-         if (syncCount >= 3)
+         //a frame is ready, but the driver is still busy -> wait, until its TX buffer is drained
+         idle = txScheduler.getTransmissionTime(txCount - threshold);
+      }
+   }
+   leaveCritical();
+   return idle;
+}
+
+
+void Slay2::doReception(const unsigned int time1ms)
+{
+   //frames, received out of order, may be stuck by a full delivery queue resp. RX ring. it has been drained meanwhile
+   deliverReordered();
+   unsigned char rxBlock[SLAY2_RX_BLOCK_SIZE];
+   int rxCount;
+
+   //fetch all the available input, block by block (instead of one byte per receive call)
+   while ((rxCount = this->receive(rxBlock, sizeof(rxBlock))) > 0)
+   {
+      //run the state machine over all bytes of the block. its state is kept in member variables,
+      //so frames and SYNC sequences may be split across blocks
+      for (int i = 0; i < rxCount; ++i)
+      {
+         const unsigned char rxBuffer = rxBlock[i];
+         //SYN
+         if (rxBuffer == SLAY2_SYNC)
+         {
+            ++syncCount;
+            if (verbose) cout << "SLAY2: SYNC received" << endl;
+            if (syncCount >= 3)
+            {
+               if (verbose) cout << "SLAY2: reset for synchronisation" << endl;
+               ++stats.syncResets;
+               syncCount = 0;
+               //a consecutive receive sequence of 3 or more SYNC chars, leads to clear the "receive sequence lock"
+               //as a consequence of that, the receiver does not longer expects the next frame to has a sequence
+               //number of "one more than the previous".
+               //this is required to get in sync with the remote station.
+               //at startup a remote station shall tranmit 5 (or more) SYNC chars for synchronisation;
+               reset();
+            }
+            continue;
+         }
+         syncCount = 0;
+
+         //ACK
+         if (Slay2AckDecodingBuffer::isAck(rxBuffer))
+         {
+            //decode the whole sequence of consecutive ACK bytes at once
+            int end = i + 1;
+            while ((end < rxCount) && Slay2AckDecodingBuffer::isAck(rxBlock[end]))
+            {
+               ++end;
+            }
+            rxAckDecoder.pushAck(&rxBlock[i], end - i);
+            i = end - 1;
+            continue;
+         }
+         if (Slay2AckDecodingBuffer::isEndOfAck(rxBuffer))
          {
-            if (verbose) cout << "SLAY2: reset for synchronisation" << endl;
-            syncCount = 0;
-            //a consecutive receive sequence of 3 or more SYNC chars, leads to clear the "receive sequence lock"
-            //as a consequence of that, the receiver does not longer expects the next frame to has a sequence
-            //number of "one more than the previous".
-            //this is required to get in sync with the remote station.
-            //at startup a remote station shall tranmit 5 (or more) SYNC chars for synchronisation;
-            txScheduler.reset();
+            if (verbose) cout << "SLAY2: ACK frame finished. CRC=" << rxAckDecoder.getCrc32() << endl;
+            if (rxAckDecoder.getCrc32() == 0) //CRC of valid frames is 0!
+            {
+               const unsigned char * ackBuffer = rxAckDecoder.getBuffer();
+               unsigned int ackLen = rxAckDecoder.getCount();
+               if (ackLen == 5) //length of ACK frames is 5 (1 byte seqNr, 4 byte CRC)
+               {
+                  const unsigned char seqNr = ackBuffer[0]; //1st byte is expected to be the sequence number
+                  txScheduler.acknowledgeXfer(seqNr, time1ms);
+               }
+               else if ((ackLen >= 6) && (ackBuffer[0] == SLAY2_ACK_TYPE_CUMULATIVE)) //1 byte type, 1 byte seqNr, N byte bitmap, 4 byte CRC
+               {
+                  txScheduler.acknowledgeCumulative(ackBuffer[1], &ackBuffer[2], ackLen - 6, time1ms);
+               }
+               else if ((ackLen == 6) && (ackBuffer[0] == SLAY2_ACK_TYPE_NAK)) //1 byte type, 1 byte seqNr, 4 byte CRC
+               {
+                  txScheduler.retransmitXfer(ackBuffer[1], time1ms);
+               }
+               else if ((ackLen == 7) && (ackBuffer[0] == SLAY2_ACK_TYPE_HELLO)) //1 byte type, 2 byte max. payload, 4 byte CRC
+               {
+                  const unsigned int payload = ((unsigned int)ackBuffer[1] << 8) | ackBuffer[2];
+                  setFramePayload((payload < maxFramePayload) ? payload : maxFramePayload);
+               }
+               notifyReceived(); //frames may be acknowledged -> wake up flushAndWait()
+            }
+            else if (rxAckDecoder.getCount() > 0)
+            {
+               ++stats.crcErrors;
+            }
             rxAckDecoder.flush();
+            rxDataDecoder.flush(); //frames are not interleaved. any DATA byte received before is garbage (e.g. a corrupted ACK byte)
+            continue;
+         }
+
+         //DATA
+         if (Slay2DataDecodingBuffer::isData(rxBuffer))
+         {
+            //decode the whole sequence of consecutive DATA bytes at once
+            int end = i + 1;
+            while ((end < rxCount) && Slay2DataDecodingBuffer::isData(rxBlock[end]))
+            {
+               ++end;
+            }
+            rxDataDecoder.pushData(&rxBlock[i], end - i);
+            i = end - 1;
+            continue;
+         }
+         if (Slay2DataDecodingBuffer::isEndOfData(rxBuffer))
+         {
+            if (verbose) cout << "SLAY2: DATA frame finished. CRC=" << rxDataDecoder.getCrc32() << endl;
+            const bool compressed = Slay2DataDecodingBuffer::isCompressed(rxBuffer);
+            if (rxDataDecoder.isCrcValid(compressed))
+            {
+               const unsigned char * dataBuffer = rxDataDecoder.getBuffer();
+               unsigned int dataLen = rxDataDecoder.getCount();
+               if (dataLen > 6) //length of DATA frames is 6+X (1 byte seqNr, 1 byte channel number, X byte payload, 4 byte CRC)
+               {
+                  const unsigned char seqNr = dataBuffer[0]; //1st byte is expected to be the sequence number
+                  //position of the frame, relative to the next expected one (8-bit arithmetic, wraps around)
+                  const unsigned char offset = (unsigned char)(seqNr - nextExpRxSeqNr);
+                  if ((offset == 0) && (isDeliverable(dataBuffer[1], dataLen - 6, compressed) == false))
+                  {
+                     //deferred delivery, RX ring: the application does not keep up (or there is no memory for the
+                     //decompressor) -> drop the frame, without acknowledge
+                     ++stats.deliveryDrops;
+                  }
+                  else if (offset == 0)
+                  {
+                     //that's the expected frame -> deliver it
+                     deliver(dataBuffer[1], (unsigned char *)&dataBuffer[2], dataLen - 6, compressed);
+                     ++nextExpRxSeqNr;
+                     nakSent = false;
+                     rxReorder.pop();
+                     //selective repeat: the gap may be filled now -> deliver the frames, received out of order before
+                     deliverReordered();
+                     if (rxReorder.getCount() > 0)
+                     {
+                        requestRetransmission(); //there is another gap
+                     }
+                     scheduleAck(seqNr, time1ms, false);
+                  }
+                  else if (selectiveRepeat == false)
+                  {
+                     //go-back-N: drop frames out of order. but acknowledge them anyway (the sender ignores acknowledges,
+                     //except of its oldest frame. that is a retransmission of an already delivered frame, whose acknowledge got lost)
+                     ++stats.outOfSequence;
+                     if (offset < 128)
+                     {
+                        requestRetransmission(); //frame is ahead of the expected one -> the expected one got lost
+                     }
+                     scheduleAck(seqNr, time1ms, true);
+                  }
+                  else if (offset < rxReorder.getSize())
+                  {
+                     //selective repeat: frame is ahead of the expected one -> keep it (channel number and payload), until the gap is filled.
+                     //the sequence number is replaced by the compression flag
+                     unsigned char * const frame = (unsigned char *)dataBuffer;
+                     frame[0] = compressed;
+                     rxReorder.put(offset, frame, dataLen - 4);
+                     requestRetransmission();
+                     scheduleAck(seqNr, time1ms, true);
+                  }
+                  else if (offset >= 128)
+                  {
+                     //selective repeat: frame is "behind" the expected one. it was already delivered, but my acknowledge
+                     //got lost -> acknowledge it again
+                     ++stats.outOfSequence;
+                     scheduleAck(seqNr, time1ms, true);
+                  }
+                  else
+                  {
+                     //frame is beyond the reorder buffer -> drop it, without acknowledge
+                     ++stats.outOfSequence;
+                     requestRetransmission();
+                  }
+               }
+            }
+            else if (rxDataDecoder.getCount() > 0)
+            {
+               ++stats.crcErrors;
+            }
             rxDataDecoder.flush();
-            nextExpRxSeqNr = 0;
+            rxAckDecoder.flush(); //frames are not interleaved. any ACK byte received before is garbage (e.g. a corrupted DATA byte)
+            continue;
          }
+         //just drop unexpected chars
          continue;
       }
-      syncCount = 0;
+      //a block that was not completely filled, indicates that there is no more input pending
+      if (rxCount < (int)sizeof(rxBlock))
+      {
+         break;
+      }
+   }
+}
 
-      //ACK
-      if (Slay2AckDecodingBuffer::isAck(rxBuffer))
+
+//acknowledge the reception of a data frame.
+//either by an individual ACK frame, or by updating the (delayed) cumulative ACK frame.
+//urgent acknowledges (of frames out of order) are not delayed
+void Slay2::scheduleAck(const unsigned char seqNr, const unsigned int time1ms, const bool urgent)
+{
+   if (cumulativeAck == false)
+   {
+      txScheduler.scheduleAck(seqNr);
+      return;
+   }
+   //all frames before the next expected one were received. frames out of order are given by the bitmap
+   unsigned char bitmap[SLAY2_ACK_BITMAP] = { 0 };
+   unsigned int bitmapLen = 0;
+   const unsigned int reorderSize = rxReorder.getSize();
+   for (unsigned int offset = 1; (offset < reorderSize) && (offset <= (8 * SLAY2_ACK_BITMAP)); ++offset)
+   {
+      if (rxReorder.isValid(offset))
       {
-         rxAckDecoder.pushAck(rxBuffer);
-         continue;
+         const unsigned int bit = offset - 1; //bit 0 refers to the frame after the next expected one
+         bitmap[bit / 8] |= (unsigned char)(1u << (bit % 8));
+         bitmapLen = (bit / 8) + 1;
+      }
+   }
+   txScheduler.scheduleCumulativeAck((unsigned char)(nextExpRxSeqNr - 1), bitmap, bitmapLen, time1ms, urgent);
+}
+
+
+//deliver received data to the receiver of the respective channel
+//data must provide space for one more byte (used for zero termination)
+void Slay2::deliver(const unsigned char ch, unsigned char * const data, const unsigned int len, const bool compressed)
+{
+   if (isChannel(ch))
+   {
+      unsigned char unpacked[SLAY2_LZ_INPUT + 1]; //1 more byte for zero termination
+      unsigned char * payload = data;
+      unsigned int payloadLen = len;
+      //the dictionary is kept up to date, even if the channel was closed meanwhile
+      if (compressed && (decompressors[ch] == NULL))
+      {
+         ++stats.unopenedChannel; //acknowledged, but dropped. a decompressor is allocated for open channels only
+         return;
+      }
+      if (compressed)
+      {
+         //the decompressor is allocated by isDeliverable(), before the frame is acknowledged
+         const int unpackedLen = decompressors[ch]->decompress(data, len, unpacked);
+         if (unpackedLen < 0)
+         {
+            //the CRC is valid, so the dictionaries are out of sync. the frame is acknowledged already
+            if (verbose) cout << "SLAY2: corrupted compressed frame" << endl;
+            ++stats.decompressionErrors;
+            return;
+         }
+         payload = unpacked;
+         payloadLen = (unsigned int)unpackedLen;
+      }
+      else if (decompressors[ch] != NULL)
+      {
+         decompressors[ch]->append(data, len); //raw frame of a compressed channel: part of the dictionary
       }
-      if (Slay2AckDecodingBuffer::isEndOfAck(rxBuffer))
+
+      Slay2Channel * const channel = channels[ch];
+      if (channel != NULL)
       {
-         if (verbose) cout << "SLAY2: ACK frame finished. CRC=" << rxAckDecoder.getCrc32() << endl;
-         if (rxAckDecoder.getCrc32() == 0) //CRC of valid frames is 0!
+         ++stats.rxFrames;
+         stats.rxBytes += payloadLen;
+         ++stats.channels[ch].rxFrames;
+         stats.channels[ch].rxBytes += payloadLen;
+         Slay2Receiver receiver = channel->receiver;
+         if (channel->rxFifo.getBuffer() != NULL)
          {
-            const unsigned char * ackBuffer = rxAckDecoder.getBuffer();
-            unsigned int ackLen = rxAckDecoder.getCount();
-            if (ackLen == 5) //length of ACK frames is 5 (1 byte seqNr, 4 byte CRC)
+            //RX ring: the application reads the data (there is space, see isDeliverable)
+            channel->rxFifo.pushN(payload, payloadLen);
+            notifyReceived();
+         }
+         else if (rxDelivery.getBuffer() != NULL)
+         {
+            //deferred delivery: queue the data (there is space, see isDeliverable)
+            if ((receiver != NULL) || (channel->batchReceiver != NULL))
             {
-               const unsigned char seqNr = ackBuffer[0]; //1st byte is expected to be the sequence number
-               txScheduler.acknowledgeXfer(seqNr);
+               rxDelivery.push(ch, payload, payloadLen);
             }
          }
-         rxAckDecoder.flush();;
-         continue;
+         else if (receiver != NULL)
+         {
+            //force "zero termination" at the end of RX data (e.g. this overwrites one of the CRC bytes!)
+            payload[payloadLen] = 0;
+            //callback to application
+            receiver(channel->receiverObj, payload, payloadLen);
+         }
+      }
+      else
+      {
+         ++stats.unopenedChannel; //acknowledged, but dropped
       }
+   }
+}
 
-      //DATA
-      if (Slay2DataDecodingBuffer::isData(rxBuffer))
+
+//deliver all frames, that were received out of order (and are in sequence now)
+void Slay2::deliverReordered(void)
+{
+   unsigned char * frame;
+   unsigned int len;
+   while ((frame = rxReorder.top(&len)) != NULL)
+   {
+      if (isDeliverable(frame[1], len - 2, frame[0] != 0) == false)
       {
-         rxDataDecoder.pushData(rxBuffer);
-         continue;
+         break; //resumed by the next doReception
       }
-      if (Slay2DataDecodingBuffer::isEndOfData(rxBuffer))
+      deliver(frame[1], &frame[2], len - 2, frame[0] != 0); //compression flag, channel number, payload
+      ++nextExpRxSeqNr;
+      rxReorder.pop();
+   }
+}
+
+
+bool Slay2::isDeliverable(const unsigned char ch, const unsigned int len, const bool compressed)
+{
+   if ((isChannel(ch) == false) || (channels[ch] == NULL))
+   {
+      return true; //the channel is not open: the frame is acknowledged, but dropped by deliver()
+   }
+   //a compressed frame needs the decompressor of its channel. if the pool is exhausted, the frame is not acknowledged,
+   //so it is retransmitted (and the dictionary is kept in sync)
+   if (compressed && (decompressors[ch] == NULL))
+   {
+      void * const memory = pool.alloc(sizeof(Slay2Decompressor));
+      if (memory == NULL)
       {
-         if (verbose) cout << "SLAY2: DATA frame finished. CRC=" << rxDataDecoder.getCrc32() << endl;
-         if (rxDataDecoder.getCrc32() == 0) //CRC of valid frames is 0!
+         return false;
+      }
+      decompressors[ch] = new (memory) Slay2Decompressor(); //placement new: construct it within the block of the pool
+   }
+   //the size of a decompressed payload is not known in advance
+   const unsigned int payloadLen = compressed ? SLAY2_LZ_INPUT : len;
+   if (channels[ch]->rxFifo.getBuffer() != NULL)
+   {
+      return (channels[ch]->rxFifo.getSpace() >= payloadLen);
+   }
+   if (rxDelivery.getBuffer() == NULL)
+   {
+      return true; //the receivers are called directly
+   }
+   return rxDelivery.hasSpace(payloadLen);
+}
+
+
+//the channel number of the wire format (8 bits) may exceed a reduced channel table (SLAY2_NUM_CHANNELS)
+bool Slay2::isChannel(const unsigned int channel)
+{
+   return (channel < SLAY2_NUM_CHANNELS);
+}
+
+
+bool Slay2::setDeferredDelivery(const bool enable, const bool byTask)
+{
+   bool success = true;
+   enterCritical();
+   deliveryByTask = byTask;
+   if (enable && (rxDelivery.getBuffer() == NULL))
+   {
+      unsigned char * const buffer = (unsigned char *)pool.alloc(SLAY2_DELIVERY_QUEUE);
+      rxDelivery.setBuffer(buffer, (buffer != NULL) ? SLAY2_DELIVERY_QUEUE : 0);
+      success = (buffer != NULL);
+   }
+   leaveCritical();
+   if ((enable == false) && (rxDelivery.getBuffer() != NULL))
+   {
+      while (delivering.exchange(true, std::memory_order_acquire))
+      {
+         //wait, until a concurrent deliverQueued() is finished
+      }
+      //deliver the data queued so far (the receivers are called within the critical section), then drop the queue
+      enterCritical();
+      drainDelivery();
+      unsigned char * const buffer = rxDelivery.getBuffer();
+      rxDelivery.setBuffer(NULL, 0);
+      pool.release(buffer);
+      leaveCritical();
+      delivering.store(false, std::memory_order_release);
+   }
+   return success;
+}
+
+
+unsigned int Slay2::deliverQueued(void)
+{
+   if (delivering.exchange(true, std::memory_order_acquire))
+   {
+      return 0; //another thread is delivering
+   }
+   const unsigned int count = drainDelivery();
+   delivering.store(false, std::memory_order_release);
+   return count;
+}
+
+
+//deferred delivery: call the receivers of the queued data. the data of a channel is passed to its batch receiver at
+//once (up to SLAY2_DELIVERY_BATCH payloads), the order of the payloads of a channel is kept
+unsigned int Slay2::drainDelivery(void)
+{
+   unsigned int total = 0;
+   if (rxDelivery.getBuffer() == NULL)
+   {
+      return 0;
+   }
+   while (true)
+   {
+      //take a batch of payloads (without releasing them from the queue)
+      Slay2Span spans[SLAY2_DELIVERY_BATCH];
+      unsigned char channelNrs[SLAY2_DELIVERY_BATCH];
+      unsigned int pos = rxDelivery.getReadPosition();
+      unsigned int count = 0;
+      while (count < SLAY2_DELIVERY_BATCH)
+      {
+         spans[count].data = rxDelivery.peek(&pos, &channelNrs[count], &spans[count].len);
+         if (spans[count].data == NULL)
          {
-            const unsigned char * dataBuffer = rxDataDecoder.getBuffer();
-            unsigned int dataLen = rxDataDecoder.getCount();
-            if (dataLen > 6) //length of DATA frames is 6+X (1 byte seqNr, 1 byte channel number, X byte payload, 4 byte CRC)
+            break;
+         }
+         ++count;
+      }
+      if (count == 0)
+      {
+         break;
+      }
+      //deliver them channel by channel
+      bool done[SLAY2_DELIVERY_BATCH] = { false };
+      for (unsigned int i = 0; i < count; ++i)
+      {
+         if (done[i])
+         {
+            continue;
+         }
+         const unsigned char ch = channelNrs[i];
+         Slay2Span batch[SLAY2_DELIVERY_BATCH];
+         unsigned int batchCount = 0;
+         for (unsigned int j = i; j < count; ++j)
+         {
+            if ((done[j] == false) && (channelNrs[j] == ch))
             {
-               const unsigned char seqNr = dataBuffer[0]; //1st byte is expected to be the sequence number
-               txScheduler.scheduleAck(seqNr);
-               if (seqNr == nextExpRxSeqNr)
-               {
-                  const unsigned char ch = dataBuffer[1];
-                  if (ch < SLAY2_NUM_CHANNELS)
-                  {
-                     Slay2Channel * const channel = channels[ch];
-                     if (channel != NULL)
-                     {
-                        Slay2Receiver receiver = channel->receiver;
-                        if (receiver != NULL)
-                        {
-                           //force "zero termination" at the end of RX data (this overwrites one of the CRC bytes!)
-                           ((unsigned char *)dataBuffer)[2 + (dataLen - 6)] = 0;
-                           //callback to application
-                           receiver(channel->receiverObj, &dataBuffer[2], dataLen - 6);
-                        }
-                     }
-                  }
-                  ++nextExpRxSeqNr;
-               }
+               batch[batchCount++] = spans[j];
+               done[j] = true;
             }
          }
-         rxDataDecoder.flush();;
-         continue;
+         //the channel may have been closed meanwhile
+         enterCritical();
+         Slay2Channel * const channel = channels[ch];
+         const Slay2BatchReceiver batchReceiver = (channel != NULL) ? channel->batchReceiver : NULL;
+         void * const batchReceiverObj = (channel != NULL) ? channel->batchReceiverObj : NULL;
+         const Slay2Receiver receiver = (channel != NULL) ? channel->receiver : NULL;
+         void * const receiverObj = (channel != NULL) ? channel->receiverObj : NULL;
+         leaveCritical();
+         if (batchReceiver != NULL)
+         {
+            batchReceiver(batchReceiverObj, batch, batchCount);
+         }
+         else if (receiver != NULL)
+         {
+            for (unsigned int j = 0; j < batchCount; ++j)
+            {
+               receiver(receiverObj, batch[j].data, batch[j].len);
+            }
+         }
+      }
+      rxDelivery.release(pos);
+      total += count;
+   }
+   if ((total > 0) && (rxReorder.getCount() > 0))
+   {
+      notify(); //frames received out of order may be stuck by the full queue -> run task()
+   }
+   return total;
+}
+
+
+//request the retransmission of the next expected frame by a NAK frame (fast retransmission), as soon as a gap is detected.
+//only one NAK per missing frame. if it gets lost, the transmission timeout of the sender still applies
+void Slay2::requestRetransmission(void)
+{
+   if (negativeAck && (nakSent == false))
+   {
+      txScheduler.scheduleNak(nextExpRxSeqNr);
+      nakSent = true;
+   }
+}
+
+
+void Slay2::doTransmission(const unsigned int time1ms)
+{
+   if (getTxCount() <= txScheduler.getTxThreshold()) //if less/equal than 24 chars (or 2 ms at high baudrates) in TX buffer -> add another frame
+   {
+      //a frame, that did not fit into the TX buffer of the driver (e.g. a large frame), is continued first
+      if (txPending == NULL)
+      {
+         txPending = txScheduler.getNextXfer(time1ms, channels);
+         txPendingOffset = 0;
+      }
+      if (txPending != NULL)
+      {
+         const int count = transmit(&txPending->getBuffer()[txPendingOffset], txPending->getCount() - txPendingOffset);
+         if (count > 0)
+         {
+            txPendingOffset += (unsigned int)count;
+         }
+         if (txPendingOffset >= txPending->getCount())
+         {
+            txPending = NULL;
+         }
       }
-      //just drop unexpected chars
-      continue;
    }
 }
 
 
-void Slay2::doTransmission(void)
+//channels with a lock-free TX buffer don't update the scheduler by send(). so whether they are ready for transmission,
+//is updated here (within the critical section)
+void Slay2::collectSent(void)
 {
-   if (getTxCount() <= 24) //if less/equal than 24 chars in TX buffer -> add another frame (Note: 24 ^= 3 ACK frames)
+   for (unsigned int word = 0; word < ((SLAY2_NUM_CHANNELS + 31) / 32); ++word)
    {
-      const unsigned int time1ms = getTime1ms();
-      Slay2Buffer * txBuffer = txScheduler.getNextXfer(time1ms, channels, SLAY2_NUM_CHANNELS);
-      if (txBuffer != NULL)
+      unsigned int bits = sentChannels[word].exchange(0, std::memory_order_acquire);
+      for (unsigned int bit = 0; bits != 0; ++bit, bits >>= 1)
       {
-         //whenever i am going to start a new transmission, i have to flush the rxAckDecoder...
-         rxAckDecoder.flush();
-         transmit(txBuffer->getBuffer(), txBuffer->getCount());
+         const unsigned int channel = (word * 32) + bit;
+         if ((bits & 1) && (channels[channel] != NULL))
+         {
+            txScheduler.updateReady(channels[channel]);
+         }
       }
    }
 }
 
 
-Slay2Channel * Slay2::open(const unsigned int channel)
+//snapshot of the statistics. the counters are updated by task(), so they are copied within the critical section
+void Slay2::getStats(Slay2Stats * const stats)
+{
+   if (stats != NULL)
+   {
+      enterCritical();
+      *stats = this->stats;
+      leaveCritical();
+      stats->rttAvg = (stats->rttCount > 0) ? (unsigned int)(stats->rttSum / stats->rttCount) : 0;
+   }
+}
+
+
+void Slay2::resetStats(void)
+{
+   enterCritical();
+   memset(&stats, 0, sizeof(stats));
+   leaveCritical();
+}
+
+
+void Slay2::setSchedulingPolicy(const Slay2SchedulingPolicy policy)
+{
+   enterCritical();
+   txScheduler.setSchedulingPolicy(policy);
+   leaveCritical();
+}
+
+
+Slay2Channel * Slay2::open(const unsigned int channel, const unsigned int weight, const unsigned int txBufferSize,
+                           const unsigned int rxBufferSize)
 {
    if (channel < SLAY2_NUM_CHANNELS)
    {
       if (this->channels[channel] == NULL)
       {
-         Slay2Channel * ch = new Slay2Channel(this, channel);
-         if (ch != NULL)
+         //the channel object and its TX buffer (and RX ring) are taken from the pool
+         const unsigned int size = Slay2Pool::getBlockSize((txBufferSize > SLAY2_FIFO_MIN) ? txBufferSize : SLAY2_FIFO_MIN);
+         enterCritical();
+         const unsigned int rxSize = getRxRingSize(rxBufferSize, maxFramePayload);
+         void * const memory = pool.alloc(sizeof(Slay2Channel));
+         unsigned char * const buffer = (unsigned char *)pool.alloc(size);
+         unsigned char * const rxBuffer = (rxBufferSize > 0) ? (unsigned char *)pool.alloc(rxSize) : NULL;
+         Slay2Channel * ch = NULL;
+         if ((memory != NULL) && (buffer != NULL) && ((rxBuffer != NULL) || (rxBufferSize == 0)))
          {
+            ch = new (memory) Slay2Channel(this, channel); //placement new: construct the channel within the block of the pool
+            ch->weight = (weight > 0) ? weight : 1;
+            ch->txFifo.setBuffer(buffer, size);
+            ch->rxFifo.setBuffer(rxBuffer, (rxBuffer != NULL) ? rxSize : 0);
             this->channels[channel] = ch;
-            return ch;
          }
+         else
+         {
+            pool.release(memory);
+            pool.release(buffer);
+            pool.release(rxBuffer);
+         }
+         leaveCritical();
+         return ch;
       }
    }
    return NULL;
@@ -290,13 +1087,34 @@ void Slay2::close(Slay2Channel * const ch)
 {
    if (ch != NULL)
    {
-      const unsigned int channel = ch->channel;
-      if (channel < SLAY2_NUM_CHANNELS)
-      {
-         this->channels[channel] = NULL;
-      }
-      delete ch; //delete channel
+      enterCritical();
+      release(ch);
+      leaveCritical();
+   }
+}
+
+
+//remove the channel from the channel table, and give the channel object and its TX buffer back to the pool
+void Slay2::release(Slay2Channel * const ch)
+{
+   const unsigned int channel = ch->channel;
+   if (channel < SLAY2_NUM_CHANNELS)
+   {
+      ch->txFifo.flush();
+      txScheduler.updateReady(ch); //drop the channel from the set of ready channels
+      txScheduler.detachChannel(ch); //frames of the channel may still be in the window
+      this->channels[channel] = NULL;
+   }
+   if (ch->compressor != NULL)
+   {
+      ch->compressor->~Slay2Compressor();
+      pool.release(ch->compressor);
    }
+   unsigned char * const buffer = ch->txFifo.getBuffer();
+   pool.release(ch->rxFifo.getBuffer());
+   ch->~Slay2Channel();
+   pool.release(ch);
+   pool.release(buffer);
 }
 
 
@@ -310,7 +1128,17 @@ Slay2Channel::Slay2Channel(Slay2 * const slay2, const unsigned int channel)
    this->channel = channel;
    this->receiver = NULL;
    this->receiverObj = NULL;
+   this->batchReceiver = NULL;
+   this->batchReceiverObj = NULL;
    this->txMore = false;
+   this->lockFree = false;
+   this->weight = 1;
+   this->deficit = 0;
+   this->txByteCount = 0;
+   this->sentByteCount = 0;
+   this->txAckedOffset = 0;
+   this->txDroppedByteCount = 0;
+   this->compressor = NULL;
 }
 
 
@@ -321,33 +1149,56 @@ void Slay2Channel::setReceiver(const Slay2Receiver receiver, void * const obj)
 }
 
 
+void Slay2Channel::setBatchReceiver(const Slay2BatchReceiver receiver, void * const obj)
+{
+   this->batchReceiver = receiver;
+   this->batchReceiverObj = obj;
+}
+
+
 int Slay2Channel::send(const unsigned char * data, const unsigned int len, const bool more)
 {
    unsigned int count;
-   bool success;
 
-   //push data into txFifo
-   enterCritical();
-   for (count = 0; count < len; ++count)
+   if (lockFree)
    {
-      success = txFifo.push(*data);
-      if (success == true)
-      {
-         ++data;
-         continue;
-      }
-      break;
+      //push data into txFifo (as much as fits into it), and set the more flag. the state of the scheduler is
+      //updated by the next task()
+      count = txFifo.pushN(data, len);
+      sentByteCount.store(sentByteCount.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+      this->txMore = more;
+      slay2->sentChannels[channel / 32].fetch_or(1u << (channel % 32), std::memory_order_release);
+   }
+   else
+   {
+      //push data into txFifo (as much as fits into it)
+      enterCritical();
+      count = txFifo.pushN(data, len);
+      sentByteCount.store(sentByteCount.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+      //set more (data will follow) flag
+      this->txMore = more;
+      slay2->txScheduler.updateReady(this);
+      leaveCritical();
+   }
+   if (count > 0)
+   {
+      slay2->notify();
    }
-   //set more (data will follow) flag
-   this->txMore = more;
-   leaveCritical();
    return (int)count;
 }
 
 
+void Slay2Channel::setLockFree(const bool enable)
+{
+   enterCritical();
+   lockFree = enable;
+   leaveCritical();
+}
+
+
 unsigned int Slay2Channel::getTxBufferSize()
 {
-   return SLAY2_FIFO_SIZE;
+   return txFifo.getSize();
 }
 
 unsigned int Slay2Channel::getTxBufferSpace()
@@ -358,8 +1209,144 @@ unsigned int Slay2Channel::getTxBufferSpace()
 void Slay2Channel::flushTxBuffer()
 {
    enterCritical();
-   txFifo.flush();
+   const unsigned int dropped = txFifo.flush();
+   txAckedOffset += dropped;
+   txDroppedByteCount += dropped;
+   slay2->txScheduler.updateReady(this);
+   slay2->notifyReceived(); //wake up flushAndWait()
+   leaveCritical();
+}
+
+
+unsigned long long Slay2Channel::getTxByteCount()
+{
+   enterCritical();
+   const unsigned long long count = txByteCount;
+   leaveCritical();
+   return count;
+}
+
+
+int Slay2Channel::read(unsigned char * data, const unsigned int len, const unsigned int timeout1ms)
+{
+   if (rxFifo.getBuffer() == NULL)
+   {
+      return -1;
+   }
+   enterCritical();
+   const unsigned int start1ms = slay2->getTime1ms();
+   while ((rxFifo.getCount() == 0) && (len > 0))
+   {
+      const unsigned int elapsed1ms = slay2->getTime1ms() - start1ms;
+      if ((elapsed1ms >= timeout1ms) || (slay2->waitEvent(timeout1ms - elapsed1ms) == false))
+      {
+         break; //timeout
+      }
+   }
+   const unsigned int count = rxFifo.popN(data, len);
+   if ((count > 0) && (slay2->rxReorder.getCount() > 0))
+   {
+      slay2->notify(); //frames received out of order may be stuck by the full RX ring -> run task()
+   }
+   leaveCritical();
+   return (int)count;
+}
+
+
+int Slay2Channel::peek(unsigned char * data, const unsigned int len)
+{
+   if (rxFifo.getBuffer() == NULL)
+   {
+      return -1;
+   }
+   const unsigned char * seg[2];
+   unsigned int segLen[2];
+   enterCritical();
+   const unsigned int count = rxFifo.peek(seg, segLen, len);
+   memcpy(data, seg[0], segLen[0]);
+   memcpy(&data[segLen[0]], seg[1], segLen[1]);
+   leaveCritical();
+   return (int)count;
+}
+
+
+unsigned int Slay2Channel::getRxCount()
+{
+   return rxFifo.getCount();
+}
+
+
+unsigned long long Slay2Channel::getSentByteCount()
+{
+   return sentByteCount.load(std::memory_order_relaxed);
+}
+
+
+unsigned long long Slay2Channel::getAckedByteCount()
+{
+   enterCritical();
+   const unsigned long long offset = txAckedOffset;
+   leaveCritical();
+   return offset;
+}
+
+
+unsigned long long Slay2Channel::getDroppedByteCount()
+{
+   enterCritical();
+   const unsigned long long count = txDroppedByteCount;
+   leaveCritical();
+   return count;
+}
+
+
+bool Slay2Channel::flushAndWait(const unsigned int timeout1ms)
+{
+   enterCritical();
+   const unsigned long long offset = sentByteCount.load(std::memory_order_relaxed);
+   const unsigned long long dropped = txDroppedByteCount;
+   if (txMore)
+   {
+      txMore = false; //no more data will follow -> the rest of the TX buffer is transmitted
+      slay2->txScheduler.updateReady(this);
+      slay2->notify();
+   }
+   const unsigned int start1ms = slay2->getTime1ms();
+   while ((txAckedOffset < offset) && (txDroppedByteCount == dropped))
+   {
+      const unsigned int elapsed1ms = slay2->getTime1ms() - start1ms;
+      if ((elapsed1ms >= timeout1ms) || (slay2->waitEvent(timeout1ms - elapsed1ms) == false))
+      {
+         break; //timeout
+      }
+   }
+   const bool success = (txAckedOffset >= offset) && (txDroppedByteCount == dropped);
+   leaveCritical();
+   return success;
+}
+
+
+bool Slay2Channel::setCompression(const bool enable)
+{
+   bool success = true;
+   enterCritical();
+   if (enable && (compressor == NULL))
+   {
+      void * const memory = slay2->pool.alloc(sizeof(Slay2Compressor));
+      success = (memory != NULL);
+      if (success)
+      {
+         compressor = new (memory) Slay2Compressor(); //its first frame resets the dictionary of the remote endpoint
+      }
+   }
+   else if ((enable == false) && (compressor != NULL))
+   {
+      compressor->~Slay2Compressor();
+      slay2->pool.release(compressor);
+      compressor = NULL;
+   }
    leaveCritical();
+   return success;
 }
 
 
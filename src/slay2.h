@@ -11,33 +11,130 @@
 #include <string.h>
 #include "slay2_buffer.h"
 #include "slay2_scheduler.h"
+#include "slay2_compression.h"
 
 /* -- Defines ------------------------------------------------------------- */
-#define SLAY2_NUM_CHANNELS    (8) //up to 256 channels are possible
+#ifndef SLAY2_NUM_CHANNELS
+ #define SLAY2_NUM_CHANNELS   (SLAY2_MAX_CHANNELS) //all 256 channels of the wire format. a smaller number saves the memory of the channel table
+#endif
+
+#ifndef SLAY2_RX_BLOCK_SIZE
+ #define SLAY2_RX_BLOCK_SIZE  (256) //number of bytes fetched by a single "receive" call (reception buffer is allocated on stack)
+#endif
+
+#ifndef SLAY2_WAIT_POLL
+ #define SLAY2_WAIT_POLL      (1)   //[ms] period of task(), run by a blocking call itself (no other thread calls task())
+#endif
+
 
 /* -- Types --------------------------------------------------------------- */
 typedef void (*Slay2Receiver)(void * const obj, const unsigned char * const data, const unsigned int len);
 
+//a received payload (zero terminated), passed to a batch receiver. valid during the call only
+struct Slay2Span
+{
+   const unsigned char * data;
+   unsigned int len;
+};
+//deferred delivery: several payloads of a channel (in order) at once
+typedef void (*Slay2BatchReceiver)(void * const obj, const Slay2Span * const spans, const unsigned int count);
+
+
+//counters of a channel (by channel number, independent of opening/closing the channel)
+struct Slay2ChannelStats
+{
+   unsigned long long txFrames; //data frames (without retransmissions)
+   unsigned long long txBytes;  //payload bytes (uncompressed)
+   unsigned long long rxFrames; //data frames delivered to the receiver
+   unsigned long long rxBytes;  //payload bytes (uncompressed)
+};
+
+
+//counters of a link. they are updated by task(), and copied by getStats() (within the critical section)
+struct Slay2Stats
+{
+   unsigned long long txFrames; //data frames of all channels (without retransmissions)
+   unsigned long long txBytes;
+   unsigned long long rxFrames; //data frames of all channels, received in sequence
+   unsigned long long rxBytes;
+   unsigned long long retransmissions; //data frames transmitted again (timeout, NAK or go-back-N)
+   unsigned long long crcErrors; //DATA and ACK frames with an invalid CRC
+   unsigned long long outOfSequence; //data frames dropped due to their sequence number (gap, duplicate)
+   unsigned long long unopenedChannel; //data frames dropped, because their channel is not open
+   unsigned long long deliveryDrops; //data frames dropped (not acknowledged), because the delivery queue or the RX ring was full
+   unsigned long long decompressionErrors; //compressed data frames with a valid CRC, that could not be decompressed (dropped)
+   unsigned long long syncResets; //resets by a SYNC sequence of the remote endpoint
+   unsigned long long rttCount; //number of round trip time samples (acknowledges of frames, that were transmitted once)
+   unsigned long long rttSum; //[ms]
+   unsigned int rttMin; //[ms]
+   unsigned int rttMax; //[ms]
+   unsigned int rttAvg; //[ms] rttSum / rttCount (calculated by getStats)
+   unsigned long long taskCount; //number of task() calls
+   unsigned long long rxTimeSum; //time [us] spent in the reception part of task() (see getTime1us)
+   unsigned long long txTimeSum; //time [us] spent in the transmission part of task()
+   unsigned int rxTimeMax; //[us] per task() call
+   unsigned int txTimeMax; //[us] per task() call
+   Slay2ChannelStats channels[SLAY2_NUM_CHANNELS];
+};
+
 
 class Slay2Channel; //forward declaration
 
 
 class Slay2
 {
+   friend class Slay2Channel; //Slay2Channel is my friend. so this class is allowed to access my private methods/members
+
 public:
-   Slay2();
+   Slay2(const unsigned int windowSize = SLAY2_SCHEDULER_FIFO_DEPTH);
    ~Slay2();        //this also delets all open channels
    void task(void); //must be called cyclically
+   unsigned int getIdleTime(void); //time [ms] until task() must be called again, unless data is sent or received (SLAY2_NO_DEADLINE: none)
    void setVerbose(void);
+   bool setWindowSize(const unsigned int windowSize); //number of unacknowledged data frames (1..127). this leads to a re-synchronisation with the remote endpoint
+   unsigned int getWindowSize(void);
+   bool setSelectiveRepeat(const bool enable); //keep frames received out of order, and retransmit only missing frames. must be enabled on both endpoints
+   void setNegativeAck(const bool enable); //request retransmissions by NAK frames, as soon as a frame is missing. the sender always handles them
+   void setBaudrate(const unsigned int baudrate); //baudrate of the serial line (8N1). target adaptions set it by their init function
+   unsigned int getRto(void); //current retransmission timeout [ms] of a data frame with max. length (adapted to the measured round trip time)
+   void setCumulativeAck(const bool enable, const unsigned int delay1ms = SLAY2_ACK_DELAY); //acknowledge by (delayed) cumulative ACK frames. remote endpoint must support them
+   //max. payload of data frames (SLAY2_FRAME_PAYLOAD..SLAY2_MAX_FRAME_PAYLOAD). large frames are used, if the remote endpoint
+   //supports them as well (negotiated after the SYNC sequence). this leads to a re-synchronisation with the remote endpoint.
+   //RX rings of open channels, which are smaller than a frame payload, are reallocated (returns false, if pool exhausted)
+   bool setMaxFramePayload(const unsigned int maxPayload);
+   unsigned int getFramePayload(void); //max. payload of data frames, negotiated with the remote endpoint
+   void getStats(Slay2Stats * const stats); //snapshot of the counters of the link
+   void resetStats(void);
+   //deferred delivery: received data is queued, and the receivers are called outside the critical section. by the end
+   //of task() ("byTask"), or by deliverQueued() (e.g. on a worker thread). frames are not acknowledged, while the queue is
+   //full. returns false, if the pool is exhausted. disabling it delivers the queued data (within the critical section)
+   bool setDeferredDelivery(const bool enable, const bool byTask = true);
+   unsigned int deliverQueued(void); //returns the number of delivered payloads (0: none, or another thread is delivering)
 
-   Slay2Channel * open(const unsigned int channel); //returns NULL, if channel number of of range, or channel is already open
+   void setSchedulingPolicy(const Slay2SchedulingPolicy policy); //selection of the channel, that may send the next data frame
+   //returns NULL, if channel number of of range, or channel is already open, or the pool is exhausted.
+   //weight: share of the line (deficit round robin). txBufferSize: rounded up to a power of two.
+   //rxBufferSize: RX ring of read() (0: none, the receiver is called). rounded up to a power of two, min. one frame payload
+   Slay2Channel * open(const unsigned int channel, const unsigned int weight = 1, const unsigned int txBufferSize = SLAY2_FIFO_SIZE,
+                       const unsigned int rxBufferSize = 0);
    void close(Slay2Channel * const channel); //this deletes the object pointed by channel
 
    //this function must be implemented (in a derived class)
    virtual unsigned int getTime1ms(void) = 0; //public utility function. probably others can utilize it too
+   virtual unsigned int getTime1us(void) { return 0; } //optional high resolution time. used for the statistics only
    //synchronization primitives. must have recursive ownership feature. must be implemented in a derived class
    virtual void enterCritical(void) = 0;
    virtual void leaveCritical(void) = 0;
+   //called, when data was sent on any channel. event-driven target adaptions may override it, to wake up their task
+   virtual void notify(void) {}
+   //blocking read (RX rings) and flushAndWait(): wait for received data resp. acknowledges. called within the critical
+   //section, which is released while waiting. returns false on timeout. target adaptions with threads implement it
+   //(default: no waiting at all). they must not wait, if the critical section is owned more than once (e.g. within a
+   //receiver): task() could not wake them up
+   virtual bool waitReceived(const unsigned int timeout1ms) { (void)timeout1ms; return false; }
+   //another thread calls task() all the time (e.g. an I/O thread). otherwise the blocking calls run task() themselves
+   virtual bool hasTaskThread(void) { return false; }
+   virtual void notifyReceived(void) {} //data was put into an RX ring, or an ACK frame was received -> wake up waitReceived()
 
 protected:
    //this functions must be implemented (in a derived class) to connect to a hardware/plattform...
@@ -47,16 +144,48 @@ protected:
    virtual int receive(unsigned char * buffer, unsigned int size) = 0; //return number of read bytes
 
 private:
-   void doReception(void);
-   void doTransmission(void);
+   void reset(void);
+   void doReception(const unsigned int time1ms);
+   void doTransmission(const unsigned int time1ms);
+   void scheduleAck(const unsigned char seqNr, const unsigned int time1ms, const bool urgent);
+   void deliver(const unsigned char ch, unsigned char * const data, const unsigned int len, const bool compressed);
+   void deliverReordered(void);
+   //the frame can be delivered now: the RX ring of its channel resp. the delivery queue has space for its payload
+   bool isDeliverable(const unsigned char ch, const unsigned int len, const bool compressed);
+   static bool isChannel(const unsigned int channel); //within the channel table
+   static unsigned int getRxRingSize(const unsigned int rxBufferSize, const unsigned int maxPayload);
+   bool growRxRings(const unsigned int maxPayload);
+   bool waitEvent(const unsigned int timeout1ms);
+   unsigned int drainDelivery(void);
+   void requestRetransmission(void);
+   void release(Slay2Channel * const ch);
+   void setFramePayload(const unsigned int payload);
+   void collectSent(void);
 
-   Slay2Channel * channels[SLAY2_NUM_CHANNELS];
+   Slay2Pool pool; //memory of channels, TX buffers, window and reorder buffer. must be constructed first (and destructed last)
+   Slay2Stats stats; //counters of the link. updated by the TX scheduler as well
+   Slay2Channel * channels[SLAY2_NUM_CHANNELS]; //sparse table of the open channels (NULL: closed)
+   Slay2Decompressor * decompressors[SLAY2_NUM_CHANNELS]; //created by the first compressed frame of a channel
+   std::atomic<unsigned int> sentChannels[(SLAY2_NUM_CHANNELS + 31) / 32]; //bitmap of the channels, filled by a lock-free send()
    bool syncSent;
    unsigned int syncCount;
    Slay2TxScheduler txScheduler;
    Slay2AckDecodingBuffer rxAckDecoder;
    Slay2DataDecodingBuffer rxDataDecoder;
+   unsigned char * rxFrameBuffer; //buffer of the data decoder for large frames (NULL: default frames)
+   unsigned int maxFramePayload; //max. payload of the frames, I'm able to receive (announced by the HELLO frame)
+   Slay2Buffer * txPending; //frame, that did not fit into the TX buffer of the driver at once (NULL: none)
+   unsigned int txPendingOffset; //... number of bytes transmitted so far
+   Slay2ReorderBuffer rxReorder; //frames received out of order (selective repeat only)
+   Slay2DeliveryQueue rxDelivery; //received data of deferred delivery (buffer NULL: the receivers are called by doReception)
+   bool deliveryByTask; //the queue is drained by the end of task()
+   std::atomic<bool> delivering; //a thread is draining the delivery queue (single consumer)
+   bool inTask; //within the critical section of task() (e.g. a receiver is called)
    unsigned char nextExpRxSeqNr;  //expected sequence number of next received data frame!
+   bool selectiveRepeat;
+   bool cumulativeAck;
+   bool negativeAck;
+   bool nakSent; //a NAK was sent for the next expected frame
    bool verbose;
 };
 
@@ -69,10 +198,32 @@ class Slay2Channel
 
 public:
    void setReceiver(const Slay2Receiver receiver, void * const obj=NULL);
+   void setBatchReceiver(const Slay2BatchReceiver receiver, void * const obj=NULL); //deferred delivery only. precedes the receiver
    int send(const unsigned char * data, const unsigned int len, const bool more=false);
    unsigned int getTxBufferSize();
    unsigned int getTxBufferSpace();
    void flushTxBuffer();
+   unsigned long long getTxByteCount(); //number of payload bytes transmitted (served by the scheduler)
+   //RX ring (see Slay2::open): read up to "len" received bytes. waits up to "timeout1ms" for data (0: non-blocking).
+   //returns the number of bytes read (0: timeout), -1: the channel has no RX ring. the channel must not be closed meanwhile.
+   //if no other thread calls task() (see hasTaskThread), the waiting caller runs it every SLAY2_WAIT_POLL ms. within a
+   //receiver, it does not wait at all
+   int read(unsigned char * data, const unsigned int len, const unsigned int timeout1ms = 0);
+   int peek(unsigned char * data, const unsigned int len); //like a non-blocking read, but the data is kept in the RX ring
+   unsigned int getRxCount(); //number of bytes in the RX ring
+   //offsets within the byte stream of the channel: number of bytes accepted by send(), and number of bytes acknowledged by
+   //the remote endpoint (all bytes before this offset). bytes dropped by flushTxBuffer() or a re-synchronisation are
+   //skipped by the acknowledged offset (see getDroppedByteCount)
+   unsigned long long getSentByteCount();
+   unsigned long long getAckedByteCount();
+   unsigned long long getDroppedByteCount();
+   //transmit the buffered data at once (even if send() announced more), and wait up to "timeout1ms", until it is
+   //acknowledged (like read(), it runs task() itself, if no other thread does). returns false on timeout, or if data
+   //was dropped meanwhile
+   bool flushAndWait(const unsigned int timeout1ms);
+   bool setCompression(const bool enable); //compress the payload of DATA frames. the remote endpoint must support it
+   //send() without the critical section: the TX buffer is a lock-free ring, only one thread may send on the channel
+   void setLockFree(const bool enable);
    //synchronization primitives
    void enterCritical();
    void leaveCritical();
@@ -84,8 +235,19 @@ private:
    unsigned int channel;
    Slay2Receiver receiver;
    void * receiverObj;
+   Slay2BatchReceiver batchReceiver;
+   void * batchReceiverObj;
    Slay2Fifo txFifo;
-   bool txMore;
+   Slay2Fifo rxFifo; //RX ring of read() (buffer NULL: none)
+   std::atomic<bool> txMore;
+   bool lockFree;
+   unsigned int weight;  //deficit round robin: quantum in units of SLAY2_DRR_QUANTUM
+   unsigned int deficit; //deficit round robin: number of bytes, the channel may still send in this round
+   unsigned long long txByteCount;
+   std::atomic<unsigned long long> sentByteCount; //written by the sending thread only (see setLockFree)
+   unsigned long long txAckedOffset; //updated by the scheduler
+   unsigned long long txDroppedByteCount;
+   Slay2Compressor * compressor; //NULL: compression is disabled
 };
 
 
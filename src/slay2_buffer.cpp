@@ -11,7 +11,11 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <string.h>
+#include <new>
 #include "slay2_buffer.h"
+#if defined(__BMI2__)
+ #include <immintrin.h>
+#endif
 
 
 /* -- Defines ------------------------------------------------------------- */
@@ -29,6 +33,81 @@ extern "C" unsigned int xcrc32(const unsigned char *buf, int len, unsigned int i
 
 /* -- Implementation ------------------------------------------------------ */
 
+//load/store N bytes (up to 8) in little endian order, into/from a 64-bit word
+static inline unsigned long long loadLe(const unsigned char * p, const unsigned int n)
+{
+   unsigned long long v = 0;
+   for (unsigned int i = 0; i < n; ++i)
+   {
+      v |= (unsigned long long)p[i] << (8 * i);
+   }
+   return v;
+}
+
+static inline void storeLe(unsigned char * p, unsigned long long v, const unsigned int n)
+{
+   for (unsigned int i = 0; i < n; ++i)
+   {
+      p[i] = (unsigned char)(v >> (8 * i));
+   }
+}
+
+
+//7-in-8 DATA encoding of 7 bytes (56 bits) into 8 encoded bytes: byte k = 0x80 | bits[7k+6:7k]
+static inline unsigned long long encode7in8(unsigned long long v)
+{
+#if defined(__BMI2__)
+   v = _pdep_u64(v, 0x7F7F7F7F7F7F7F7FuLL);
+#else
+   v = ((v & 0x00FFFFFFF0000000uLL) << 4) | (v & 0x000000000FFFFFFFuLL); //28|28 bits -> 32-bit halves
+   v = ((v & 0x0FFFC0000FFFC000uLL) << 2) | (v & 0x00003FFF00003FFFuLL); //14|14 bits -> 16-bit quarters
+   v = ((v & 0x3F803F803F803F80uLL) << 1) | (v & 0x007F007F007F007FuLL); // 7|7  bits -> bytes
+#endif
+   return v | 0x8080808080808080uLL;
+}
+
+//inverse of encode7in8: 8 encoded bytes -> 7 bytes (56 bits)
+static inline unsigned long long decode7in8(unsigned long long v)
+{
+#if defined(__BMI2__)
+   return _pext_u64(v, 0x7F7F7F7F7F7F7F7FuLL);
+#else
+   v &= 0x7F7F7F7F7F7F7F7FuLL;
+   v = ((v & 0x7F007F007F007F00uLL) >> 1) | (v & 0x007F007F007F007FuLL);
+   v = ((v & 0x3FFF00003FFF0000uLL) >> 2) | (v & 0x00003FFF00003FFFuLL);
+   v = ((v & 0x0FFFFFFF00000000uLL) >> 4) | (v & 0x000000000FFFFFFFuLL);
+   return v;
+#endif
+}
+
+//6-in-8 ACK encoding of 6 bytes (48 bits) into 8 encoded bytes: byte k = 0x40 | bits[6k+5:6k]
+static inline unsigned long long encode6in8(unsigned long long v)
+{
+#if defined(__BMI2__)
+   v = _pdep_u64(v, 0x3F3F3F3F3F3F3F3FuLL);
+#else
+   v = ((v & 0x0000FFFFFF000000uLL) << 8) | (v & 0x0000000000FFFFFFuLL); //24|24 bits -> 32-bit halves
+   v = ((v & 0x00FFF00000FFF000uLL) << 4) | (v & 0x00000FFF00000FFFuLL); //12|12 bits -> 16-bit quarters
+   v = ((v & 0x0FC00FC00FC00FC0uLL) << 2) | (v & 0x003F003F003F003FuLL); // 6|6  bits -> bytes
+#endif
+   return v | 0x4040404040404040uLL;
+}
+
+//inverse of encode6in8: 8 encoded bytes -> 6 bytes (48 bits)
+static inline unsigned long long decode6in8(unsigned long long v)
+{
+#if defined(__BMI2__)
+   return _pext_u64(v, 0x3F3F3F3F3F3F3F3FuLL);
+#else
+   v &= 0x3F3F3F3F3F3F3F3FuLL;
+   v = ((v & 0x3F003F003F003F00uLL) >> 2) | (v & 0x003F003F003F003FuLL);
+   v = ((v & 0x0FFF00000FFF0000uLL) >> 4) | (v & 0x00000FFF00000FFFuLL);
+   v = ((v & 0x00FFFFFF00000000uLL) >> 8) | (v & 0x0000000000FFFFFFuLL);
+   return v;
+#endif
+}
+
+
 
 
 Slay2Buffer::Slay2Buffer(unsigned char *buffer, unsigned int bufferSize)
@@ -47,6 +126,7 @@ void Slay2Buffer::flush()
    count = 1; //data begins at position 1!
    step = 0;
    crc = 0xFFFFFFFFuL;
+   crcCount = 1; //data begins at position 1!
 }
 
 const unsigned char * Slay2Buffer::getBuffer()
@@ -68,19 +148,36 @@ unsigned long Slay2Buffer::getCrc32()
    return crc;
 }
 
-void Slay2Buffer::addToCrc(unsigned char c)
+void Slay2Buffer::addToCrc(const unsigned char * data, unsigned int len)
 {
-   crc = xcrc32(&c, 1, (unsigned int)crc);
+   crc = xcrc32(data, (int)len, (unsigned int)crc);
+}
+
+void Slay2Buffer::updateCrc()
+{
+   if ((buffer != NULL) && (crcCount < count))
+   {
+      addToCrc(&buffer[crcCount], count - crcCount);
+      crcCount = count;
+   }
 }
 
 
 
 bool Slay2AckEncodingBuffer::pushAck(unsigned char c)
+{
+   if (encodeAck(c))
+   {
+      addToCrc(&c, 1); //include value into crc
+      return true;
+   }
+   return false;
+}
+
+bool Slay2AckEncodingBuffer::encodeAck(unsigned char c)
 {
    if ((buffer != NULL) && (count < (size - 1)))
    {
-      //include value into crc
-      addToCrc(c);
       //add to buffer
       if (step == 0) buffer[count] = 0;
       buffer[count]    |= (unsigned char)(0x40u | ((c << 2*step) & 0x3F));
@@ -98,15 +195,42 @@ bool Slay2AckEncodingBuffer::pushAck(unsigned char c)
 
 }
 
+bool Slay2AckEncodingBuffer::pushAck(const unsigned char * data, unsigned int len)
+{
+   unsigned int i = 0;
+   bool status = true;
+   //encode byte by byte, until the encoding is aligned to a group boundary
+   while ((i < len) && (step != 0) && status)
+   {
+      status = encodeAck(data[i]);
+      i += status;
+   }
+   //encode complete groups of 6 bytes into 8 encoded bytes, at once
+   if ((buffer != NULL) && (step == 0))
+   {
+      while (((len - i) >= 6) && ((count + 8) <= size))
+      {
+         storeLe(&buffer[count], encode6in8(loadLe(&data[i], 6)), 8);
+         count += 8;
+         i += 6;
+      }
+   }
+   //encode the rest byte by byte
+   while ((i < len) && status)
+   {
+      status = encodeAck(data[i]);
+      i += status;
+   }
+   //include the whole (encoded) span into the crc, at once
+   addToCrc(data, i);
+   return (i == len);
+}
+
 bool Slay2AckEncodingBuffer::pushAckBig32(unsigned long c)
 {
-   bool status;
    //32bit, big endian like
-   status  = pushAck((unsigned char)(c >> 24));
-   status &= pushAck((unsigned char)(c >> 16));
-   status &= pushAck((unsigned char)(c >> 8));
-   status &= pushAck((unsigned char)c);
-   return status;
+   const unsigned char big32[4] = { (unsigned char)(c >> 24), (unsigned char)(c >> 16), (unsigned char)(c >> 8), (unsigned char)c };
+   return pushAck(big32, 4);
 }
 
 
@@ -126,11 +250,19 @@ bool Slay2AckEncodingBuffer::pushEndOfAck()
 
 
 bool Slay2DataEncodingBuffer::pushData(unsigned char c)
+{
+   if (encodeData(c))
+   {
+      addToCrc(&c, 1); //include value into crc
+      return true;
+   }
+   return false;
+}
+
+bool Slay2DataEncodingBuffer::encodeData(unsigned char c)
 {
    if ((buffer != NULL) && (count < (size - 1)))
    {
-      //include value into crc
-      addToCrc(c);
       //add to buffer
       if (step == 0) buffer[count] = 0;
       buffer[count]    |= (unsigned char)(0x80u | ((c << step) & 0x7F));
@@ -147,23 +279,50 @@ bool Slay2DataEncodingBuffer::pushData(unsigned char c)
    return false;
 }
 
+bool Slay2DataEncodingBuffer::pushData(const unsigned char * data, unsigned int len)
+{
+   unsigned int i = 0;
+   bool status = true;
+   //encode byte by byte, until the encoding is aligned to a group boundary
+   while ((i < len) && (step != 0) && status)
+   {
+      status = encodeData(data[i]);
+      i += status;
+   }
+   //encode complete groups of 7 bytes into 8 encoded bytes, at once
+   if ((buffer != NULL) && (step == 0))
+   {
+      while (((len - i) >= 7) && ((count + 8) <= size))
+      {
+         storeLe(&buffer[count], encode7in8(loadLe(&data[i], 7)), 8);
+         count += 8;
+         i += 7;
+      }
+   }
+   //encode the rest byte by byte
+   while ((i < len) && status)
+   {
+      status = encodeData(data[i]);
+      i += status;
+   }
+   //include the whole (encoded) span into the crc, at once
+   addToCrc(data, i);
+   return (i == len);
+}
+
 bool Slay2DataEncodingBuffer::pushDataBig32(unsigned long c)
 {
-   bool status;
    //big endian like
-   status  = pushData((unsigned char)(c >> 24));
-   status &= pushData((unsigned char)(c >> 16));
-   status &= pushData((unsigned char)(c >> 8));
-   status &= pushData((unsigned char)c);
-   return status;
+   const unsigned char big32[4] = { (unsigned char)(c >> 24), (unsigned char)(c >> 16), (unsigned char)(c >> 8), (unsigned char)c };
+   return pushData(big32, 4);
 }
 
-bool Slay2DataEncodingBuffer::pushEndOfData()
+bool Slay2DataEncodingBuffer::pushEndOfData(const bool compressed)
 {
    unsigned int count = this->count + (step != 0); //round up to byte boundary;
    if ((buffer != NULL) && (count < size))
    {
-      buffer[count++] = SLAY2_END_OF_DATA;
+      buffer[count++] = compressed ? SLAY2_END_OF_CDATA : SLAY2_END_OF_DATA;
       this->count = count;
       this->step = 0;
       return true;
@@ -171,6 +330,13 @@ bool Slay2DataEncodingBuffer::pushEndOfData()
    return false;
 }
 
+void Slay2DataEncodingBuffer::setBuffer(unsigned char * const buffer, const unsigned int size)
+{
+   this->buffer = (buffer != NULL) ? buffer : _buffer;
+   this->size = (buffer != NULL) ? size : sizeof(_buffer);
+   flush();
+}
+
 
 
 bool Slay2AckDecodingBuffer::pushAck(unsigned char c)
@@ -187,12 +353,6 @@ bool Slay2AckDecodingBuffer::pushAck(unsigned char c)
       buffer[count - 1] |= (unsigned char)(c << left);
       buffer[count] = (unsigned char)(c >> right);
 
-      //add "complete" bytes to crc
-      if (inc != 0)
-      {
-         addToCrc(buffer[count -1]);
-      }
-
       //increment number of "complete" bytes
       this->count = count;
       //preset next step
@@ -203,6 +363,44 @@ bool Slay2AckDecodingBuffer::pushAck(unsigned char c)
 }
 
 
+bool Slay2AckDecodingBuffer::pushAck(const unsigned char * data, unsigned int len)
+{
+   unsigned int i = 0;
+   bool status = true;
+   //decode byte by byte, until the decoding is aligned to a group boundary
+   while ((i < len) && (step != 0) && status)
+   {
+      status = pushAck(data[i]);
+      i += status;
+   }
+   //decode complete groups of 8 encoded bytes into 6 bytes, at once
+   //(the byte following the group is cleared, as it would be done by the byte-wise decoding)
+   if ((buffer != NULL) && (step == 0))
+   {
+      while (((len - i) >= 8) && ((count + 7) <= size))
+      {
+         storeLe(&buffer[count], decode6in8(loadLe(&data[i], 8)), 7);
+         count += 6;
+         i += 8;
+      }
+   }
+   //decode the rest byte by byte
+   while ((i < len) && status)
+   {
+      status = pushAck(data[i]);
+      i += status;
+   }
+   return (i == len);
+}
+
+
+unsigned long Slay2AckDecodingBuffer::getCrc32()
+{
+   updateCrc(); //add "complete" bytes to crc
+   return crc;
+}
+
+
 unsigned char Slay2AckDecodingBuffer::decodeAck(const unsigned char * buffer, unsigned int byteNumber)
 {
    unsigned int row = 4 * (byteNumber / 3); //calculate byte offset
@@ -229,12 +427,6 @@ bool Slay2DataDecodingBuffer::pushData(unsigned char c)
       buffer[count - 1] |= (unsigned char)(c << left);
       buffer[count] = (unsigned char)(c >> right);
 
-      //add "complete" bytes to crc
-      if (inc != 0)
-      {
-         addToCrc(buffer[count -1]);
-      }
-
       //increment number of "complete" bytes
       this->count = count;
       //preset next step
@@ -245,6 +437,63 @@ bool Slay2DataDecodingBuffer::pushData(unsigned char c)
 }
 
 
+bool Slay2DataDecodingBuffer::pushData(const unsigned char * data, unsigned int len)
+{
+   unsigned int i = 0;
+   bool status = true;
+   //decode byte by byte, until the decoding is aligned to a group boundary
+   while ((i < len) && (step != 0) && status)
+   {
+      status = pushData(data[i]);
+      i += status;
+   }
+   //decode complete groups of 8 encoded bytes into 7 bytes, at once
+   //(the byte following the group is cleared, as it would be done by the byte-wise decoding)
+   if ((buffer != NULL) && (step == 0))
+   {
+      while (((len - i) >= 8) && ((count + 8) <= size))
+      {
+         storeLe(&buffer[count], decode7in8(loadLe(&data[i], 8)), 8);
+         count += 7;
+         i += 8;
+      }
+   }
+   //decode the rest byte by byte
+   while ((i < len) && status)
+   {
+      status = pushData(data[i]);
+      i += status;
+   }
+   return (i == len);
+}
+
+
+unsigned long Slay2DataDecodingBuffer::getCrc32()
+{
+   updateCrc(); //add "complete" bytes to crc
+   return crc;
+}
+
+bool Slay2DataDecodingBuffer::isCrcValid(const bool compressed)
+{
+   if (compressed)
+   {
+      //the crc has no final xor: the inverted crc leaves the crc of the mask (calculated from zero)
+      const unsigned char mask[4] = {(unsigned char)(SLAY2_CDATA_CRC_MASK >> 24), (unsigned char)(SLAY2_CDATA_CRC_MASK >> 16),
+                                     (unsigned char)(SLAY2_CDATA_CRC_MASK >> 8), (unsigned char)SLAY2_CDATA_CRC_MASK};
+      return (getCrc32() == xcrc32(mask, sizeof(mask), 0));
+   }
+   return (getCrc32() == 0); //CRC of valid frames is 0!
+}
+
+void Slay2DataDecodingBuffer::setBuffer(unsigned char * const buffer, const unsigned int size)
+{
+   this->buffer = (buffer != NULL) ? buffer : _buffer;
+   this->size = (buffer != NULL) ? size : sizeof(_buffer);
+   flush();
+}
+
+
 unsigned char Slay2DataDecodingBuffer::decodeData(const unsigned char * buffer, unsigned int byteNumber)
 {
    unsigned int row = 8 * (byteNumber / 7); //calculate byte offset
@@ -259,60 +508,444 @@ unsigned char Slay2DataDecodingBuffer::decodeData(const unsigned char * buffer,
 
 
 
-Slay2Fifo::Slay2Fifo()
+Slay2ReorderBuffer::Slay2ReorderBuffer(Slay2Pool * const pool)
 {
+   this->pool = pool;
+   frames = NULL;
+   lens = NULL;
+   frameSize = SLAY2_RX_BUFFER;
+   size = 0;
+   head = 0;
+   count = 0;
+}
+
+Slay2ReorderBuffer::~Slay2ReorderBuffer()
+{
+   release();
+}
+
+void Slay2ReorderBuffer::release()
+{
+   pool->release(frames);
+   pool->release(lens);
+   frames = NULL;
+   lens = NULL;
+   size = 0;
+}
+
+bool Slay2ReorderBuffer::setSize(unsigned int size, unsigned int frameSize)
+{
+   if ((size != this->size) || (frameSize != this->frameSize))
+   {
+      release();
+      this->frameSize = frameSize;
+      if (size > 0)
+      {
+         frames = (unsigned char *)pool->alloc(size * frameSize);
+         lens = (unsigned int *)pool->alloc(size * sizeof(unsigned int));
+         if ((frames == NULL) || (lens == NULL))
+         {
+            release();
+            return false;
+         }
+         this->size = size;
+      }
+   }
    flush();
+   return true;
 }
 
-unsigned int Slay2Fifo::getCount()
+unsigned int Slay2ReorderBuffer::getSize()
 {
-   return count;
+   return size;
 }
 
-unsigned int Slay2Fifo::getSpace()
+void Slay2ReorderBuffer::flush()
 {
-   return (SLAY2_FIFO_SIZE - count);
+   for (unsigned int i = 0; i < size; ++i)
+   {
+      lens[i] = 0;
+   }
+   head = 0;
+   count = 0;
 }
 
-bool Slay2Fifo::push(unsigned char c)
+bool Slay2ReorderBuffer::put(unsigned int offset, const unsigned char * data, unsigned int len)
 {
-   if (count < SLAY2_FIFO_SIZE)
+   if ((offset < size) && (len > 0) && (len < frameSize)) //keep one byte for zero termination
    {
-      buffer[write++] = c;
-      if (write >= SLAY2_FIFO_SIZE) //wrap around
+      const unsigned int index = (head + offset) % size;
+      memcpy(&frames[index * frameSize], data, len);
+      if (lens[index] == 0)
       {
-         write = 0;
+         ++count;
       }
-      ++count;
+      lens[index] = len;
       return true;
    }
    return false;
 }
 
-int Slay2Fifo::pop()
+bool Slay2ReorderBuffer::isValid(unsigned int offset)
 {
-   if (count > 0)
+   return (offset < size) && (lens[(head + offset) % size] != 0);
+}
+
+unsigned int Slay2ReorderBuffer::getCount()
+{
+   return count;
+}
+
+unsigned char * Slay2ReorderBuffer::top(unsigned int * len)
+{
+   if ((size > 0) && (lens[head] != 0))
+   {
+      *len = lens[head];
+      return &frames[head * frameSize];
+   }
+   return NULL;
+}
+
+void Slay2ReorderBuffer::pop()
+{
+   if (size > 0)
    {
-      unsigned int c = buffer[read++];
-      if (read >= SLAY2_FIFO_SIZE) //wrap around
+      if (lens[head] != 0)
       {
-         read = 0;
+         --count;
       }
-      --count;
+      lens[head] = 0;
+      head = (head + 1) % size;
+   }
+}
+
+
+
+Slay2Fifo::Slay2Fifo()
+{
+   setBuffer(NULL, 0);
+}
+
+void Slay2Fifo::setBuffer(unsigned char * const buffer, const unsigned int size)
+{
+   this->buffer = buffer;
+   this->size = size;
+   this->mask = size - 1;
+   read.store(0, std::memory_order_relaxed);
+   write.store(0, std::memory_order_release);
+}
+
+unsigned char * Slay2Fifo::getBuffer()
+{
+   return buffer;
+}
+
+unsigned int Slay2Fifo::getSize()
+{
+   return size;
+}
+
+unsigned int Slay2Fifo::getCount()
+{
+   const unsigned int r = read.load(std::memory_order_acquire);
+   return write.load(std::memory_order_acquire) - r;
+}
+
+unsigned int Slay2Fifo::getSpace()
+{
+   return (size - getCount());
+}
+
+bool Slay2Fifo::push(unsigned char c)
+{
+   const unsigned int w = write.load(std::memory_order_relaxed);
+   if ((w - read.load(std::memory_order_acquire)) < size)
+   {
+      buffer[w & mask] = c;
+      write.store(w + 1, std::memory_order_release); //publish the byte
+      return true;
+   }
+   return false;
+}
+
+int Slay2Fifo::pop()
+{
+   const unsigned int r = read.load(std::memory_order_relaxed);
+   if (write.load(std::memory_order_acquire) != r)
+   {
+      unsigned int c = buffer[r & mask];
+      read.store(r + 1, std::memory_order_release); //release the space
       return c;
    }
    return -1;
 }
 
-void Slay2Fifo::flush()
+unsigned int Slay2Fifo::pushN(const unsigned char * data, unsigned int len)
 {
-   read = 0;
-   write = 0;
-   count = 0;
+   const unsigned int w = write.load(std::memory_order_relaxed);
+   const unsigned int space = size - (w - read.load(std::memory_order_acquire));
+   if (len > space)
+   {
+      len = space; //do limitation
+   }
+   //copy up to the end of the buffer, and the rest to its beginning
+   const unsigned int index = w & mask;
+   const unsigned int first = ((size - index) < len) ? (size - index) : len;
+   memcpy(&buffer[index], data, first);
+   memcpy(&buffer[0], &data[first], len - first);
+   write.store(w + len, std::memory_order_release); //publish the data
+   return len;
+}
+
+unsigned int Slay2Fifo::popN(unsigned char * data, unsigned int len)
+{
+   const unsigned char * seg[2];
+   unsigned int segLen[2];
+   len = peek(seg, segLen, len);
+   memcpy(data, seg[0], segLen[0]);
+   memcpy(&data[segLen[0]], seg[1], segLen[1]);
+   drop(len);
+   return len;
+}
+
+unsigned int Slay2Fifo::peek(const unsigned char * seg[2], unsigned int segLen[2], unsigned int len)
+{
+   const unsigned int r = read.load(std::memory_order_relaxed);
+   const unsigned int count = write.load(std::memory_order_acquire) - r;
+   if (len > count)
+   {
+      len = count; //do limitation
+   }
+   const unsigned int index = r & mask;
+   seg[0] = &buffer[index];
+   segLen[0] = ((size - index) < len) ? (size - index) : len;
+   seg[1] = &buffer[0];
+   segLen[1] = len - segLen[0];
+   return len;
+}
+
+void Slay2Fifo::drop(unsigned int len)
+{
+   const unsigned int r = read.load(std::memory_order_relaxed);
+   const unsigned int count = write.load(std::memory_order_acquire) - r;
+   if (len > count)
+   {
+      len = count; //do limitation
+   }
+   read.store(r + len, std::memory_order_release); //release the space
+}
+
+//drop all data, the producer has published so far
+unsigned int Slay2Fifo::flush()
+{
+   const unsigned int r = read.load(std::memory_order_relaxed);
+   const unsigned int w = write.load(std::memory_order_acquire);
+   read.store(w, std::memory_order_release);
+   return w - r;
+}
+
+
+
+
+
+//a record begins with a 4-byte header: payload length (little endian, 2 bytes), channel number and type.
+//a record of type "pad" fills the end of the buffer, if the next record does not fit in there
+#define SLAY2_RECORD_HEADER   (4)
+#define SLAY2_RECORD_DATA     (0)
+#define SLAY2_RECORD_PAD      (1)
+
+Slay2DeliveryQueue::Slay2DeliveryQueue()
+{
+   setBuffer(NULL, 0);
+}
+
+void Slay2DeliveryQueue::setBuffer(unsigned char * const buffer, const unsigned int size)
+{
+   this->buffer = buffer;
+   this->size = size;
+   this->mask = size - 1;
+   read.store(0, std::memory_order_relaxed);
+   write.store(0, std::memory_order_release);
+}
+
+unsigned char * Slay2DeliveryQueue::getBuffer()
+{
+   return buffer;
+}
+
+bool Slay2DeliveryQueue::isEmpty()
+{
+   return (write.load(std::memory_order_acquire) == read.load(std::memory_order_acquire));
+}
+
+unsigned int Slay2DeliveryQueue::getRecordSize(const unsigned int len)
+{
+   return (SLAY2_RECORD_HEADER + len + 1 + 3) & ~3u;
+}
+
+bool Slay2DeliveryQueue::hasSpace(const unsigned int len)
+{
+   const unsigned int w = write.load(std::memory_order_relaxed);
+   const unsigned int space = size - (w - read.load(std::memory_order_acquire));
+   const unsigned int recordSize = getRecordSize(len);
+   const unsigned int tail = size - (w & mask); //up to the end of the buffer
+   //if the record does not fit into the tail, the tail is padded
+   return (recordSize <= tail) ? (recordSize <= space) : ((tail + recordSize) <= space);
+}
+
+bool Slay2DeliveryQueue::push(const unsigned char channel, const unsigned char * data, const unsigned int len)
+{
+   if ((buffer == NULL) || (len > 0xFFFF) || !hasSpace(len))
+   {
+      return false;
+   }
+   unsigned int w = write.load(std::memory_order_relaxed);
+   const unsigned int recordSize = getRecordSize(len);
+   unsigned int index = w & mask;
+   if (recordSize > (size - index))
+   {
+      buffer[index + 3] = SLAY2_RECORD_PAD;
+      w += size - index;
+      index = 0;
+   }
+   unsigned char * const record = &buffer[index];
+   record[0] = (unsigned char)len;
+   record[1] = (unsigned char)(len >> 8);
+   record[2] = channel;
+   record[3] = SLAY2_RECORD_DATA;
+   memcpy(&record[SLAY2_RECORD_HEADER], data, len);
+   record[SLAY2_RECORD_HEADER + len] = 0; //zero termination of data
+   write.store(w + recordSize, std::memory_order_release); //publish the record (and the padding)
+   return true;
+}
+
+unsigned int Slay2DeliveryQueue::getReadPosition()
+{
+   return read.load(std::memory_order_relaxed);
+}
+
+const unsigned char * Slay2DeliveryQueue::peek(unsigned int * pos, unsigned char * channel, unsigned int * len)
+{
+   const unsigned int w = write.load(std::memory_order_acquire);
+   unsigned int p = *pos;
+   while (p != w)
+   {
+      const unsigned int index = p & mask;
+      const unsigned char * const record = &buffer[index];
+      if (record[3] == SLAY2_RECORD_PAD)
+      {
+         p += size - index; //skip the padding
+         continue;
+      }
+      *len = record[0] | (record[1] << 8);
+      *channel = record[2];
+      *pos = p + getRecordSize(*len);
+      return &record[SLAY2_RECORD_HEADER];
+   }
+   *pos = p;
+   return NULL;
+}
+
+void Slay2DeliveryQueue::release(const unsigned int pos)
+{
+   read.store(pos, std::memory_order_release); //release the space
+}
+
+//drop all records, the producer has published so far
+void Slay2DeliveryQueue::flush()
+{
+   read.store(write.load(std::memory_order_acquire), std::memory_order_release);
 }
 
 
 
 
 
+Slay2Pool::Slay2Pool()
+{
+   for (unsigned int i = 0; i < SLAY2_POOL_CLASSES; ++i)
+   {
+      freeList[i] = NULL;
+   }
+#if (SLAY2_POOL_SIZE > 0)
+   arenaUsed = 0;
+#endif
+}
 
+Slay2Pool::~Slay2Pool()
+{
+#if (SLAY2_POOL_SIZE == 0)
+   //all blocks are expected to be released by now
+   for (unsigned int i = 0; i < SLAY2_POOL_CLASSES; ++i)
+   {
+      while (freeList[i] != NULL)
+      {
+         Block * const block = freeList[i];
+         freeList[i] = block->next;
+         delete[] block;
+      }
+   }
+#endif
+}
+
+unsigned int Slay2Pool::getSizeClass(const unsigned int size)
+{
+   unsigned int sizeClass = 0;
+   while ((1u << sizeClass) < size)
+   {
+      ++sizeClass;
+   }
+   return sizeClass;
+}
+
+unsigned int Slay2Pool::getBlockSize(const unsigned int size)
+{
+   return 1u << getSizeClass(size);
+}
+
+void * Slay2Pool::alloc(const unsigned int size)
+{
+   const unsigned int sizeClass = getSizeClass((size > 0) ? size : 1);
+   if (sizeClass >= SLAY2_POOL_CLASSES)
+   {
+      return NULL;
+   }
+   //reuse a released block of the same size
+   Block * block = freeList[sizeClass];
+   if (block != NULL)
+   {
+      freeList[sizeClass] = block->next;
+   }
+   else
+   {
+      //new block: header + data (rounded up to 8-byte words)
+      const unsigned int words = 1 + (((1u << sizeClass) + 7) / 8);
+#if (SLAY2_POOL_SIZE > 0)
+      if ((arenaUsed + words) > (sizeof(arena) / sizeof(arena[0])))
+      {
+         return NULL; //arena exhausted
+      }
+      block = (Block *)&arena[arenaUsed];
+      arenaUsed += words;
+#else
+      block = new (std::nothrow) Block[words];
+      if (block == NULL)
+      {
+         return NULL;
+      }
+#endif
+   }
+   block->sizeClass = sizeClass;
+   return &block[1];
+}
+
+void Slay2Pool::release(void * const data)
+{
+   if (data != NULL)
+   {
+      Block * const block = (Block *)data - 1;
+      const unsigned int sizeClass = block->sizeClass;
+      block->next = freeList[sizeClass];
+      freeList[sizeClass] = block;
+   }
+}
@@ -9,21 +9,44 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <string.h>
+#include <atomic>
 
 /* -- Defines ------------------------------------------------------------- */
 
-#define SLAY2_FRAME_PAYLOAD   (256)    //max. payload of an SLAY2 frame is 256 bytes
-#define SLAY2_RX_BUFFER       (SLAY2_FRAME_PAYLOAD + 8)           //in addition to the payloay bytes, a receive buffer must keep the sequence number, channel number and CRC, plus 2 reserved bytes
-#define SLAY2_TX_BUFFER       ((8 * SLAY2_RX_BUFFER) / 7 + 3)     //transmitter must buffer the encoded date, wich is 8/7 of the tx data. 1 additional byte each for "round up", end of frame character and 1 reserved byte
-#define SLAY2_ACK_BUFFER      (16)     //16bytes is enough for encoded and decoded ACK frames...
-
-#define SLAY2_FIFO_SIZE       (1024)
+#define SLAY2_FRAME_PAYLOAD   (256)    //max. payload of an SLAY2 frame is 256 bytes (default frame format)
+#ifndef SLAY2_MAX_FRAME_PAYLOAD
+ #define SLAY2_MAX_FRAME_PAYLOAD (4096) //max. payload of large frames, if negotiated with the remote endpoint (max. 65535)
+#endif
+#define SLAY2_RX_BUFFER_SIZE(payload) ((payload) + 8)                         //in addition to the payloay bytes, a receive buffer must keep the sequence number, channel number and CRC, plus 2 reserved bytes
+#define SLAY2_TX_BUFFER_SIZE(payload) ((8 * SLAY2_RX_BUFFER_SIZE(payload)) / 7 + 3) //transmitter must buffer the encoded date, wich is 8/7 of the tx data. 1 additional byte each for "round up", end of frame character and 1 reserved byte
+#define SLAY2_RX_BUFFER       (SLAY2_RX_BUFFER_SIZE(SLAY2_FRAME_PAYLOAD))
+#define SLAY2_TX_BUFFER       (SLAY2_TX_BUFFER_SIZE(SLAY2_FRAME_PAYLOAD))
+#define SLAY2_ACK_BITMAP      (16)     //max. number of bitmap bytes within a cumulative ACK frame (16 bytes -> 128 frames)
+#define SLAY2_ACK_BUFFER      (40)     //40bytes is enough for encoded and decoded ACK frames (incl. cumulative ACK frames with full bitmap)...
+
+#define SLAY2_FIFO_SIZE       (1024)   //default size of the TX buffer of a channel
+#define SLAY2_FIFO_MIN        (16)     //min. size of a fifo. the size is rounded up to a power of two (wrap around by mask)
+#define SLAY2_DELIVERY_QUEUE  (16384)  //size of the queue of deferred delivery [bytes] (power of two). must keep at least two max. payloads
+#define SLAY2_DELIVERY_BATCH  (64)     //max. number of payloads, delivered by a single call of the batch receiver
+
+#ifndef SLAY2_POOL_SIZE
+ #define SLAY2_POOL_SIZE      (0)      //size of a static arena [bytes] for all the memory of a Slay2 instance (no heap at all). 0: the pool uses the heap
+#endif
+#define SLAY2_POOL_CLASSES    (24)     //block sizes of 2^0 .. 2^23 bytes
 
 
 // #define SLAY2_ACK_ID    (0x40)      //bit[7:6] = 0b01, bit[5:0] = xxx
 // #define SLAY2_DATA_ID   (0x80)      //bit[7] = 0b1, bit[6:0] = xxx
 #define SLAY2_END_OF_ACK      (1)
 #define SLAY2_END_OF_DATA     (2)
+#define SLAY2_END_OF_CDATA    (3)      //end of a DATA frame with compressed payload
+#define SLAY2_CDATA_CRC_MASK  (0xFFFFFFFFul) //CRC of compressed DATA frames is inverted, so a corrupted end byte can not
+                                           //turn a raw frame into a compressed one (and vice versa)
+
+//ACK frames, longer than 5 bytes, begin with a type byte
+#define SLAY2_ACK_TYPE_CUMULATIVE   (0x01)
+#define SLAY2_ACK_TYPE_NAK          (0x02)
+#define SLAY2_ACK_TYPE_HELLO        (0x03)
 
 /* -- Types --------------------------------------------------------------- */
 class Slay2Buffer
@@ -36,12 +59,14 @@ public:
    unsigned long getCrc32();
 
 protected:
-   void addToCrc(unsigned char c);
+   void addToCrc(const unsigned char * data, unsigned int len);
+   void updateCrc(); //include all "complete" bytes of the buffer, which are not yet part of the crc (used by decoders)
    unsigned char *buffer;
    unsigned int size;
    unsigned int count; //number of "complete" bytes in buffer
    unsigned int step;
    unsigned long crc;
+   unsigned int crcCount; //number of buffer bytes, already included in crc (used by decoders)
 };
 
 
@@ -52,10 +77,12 @@ class Slay2AckEncodingBuffer : public Slay2Buffer
 public:
    Slay2AckEncodingBuffer() : Slay2Buffer(_buffer, sizeof(_buffer)) { };
    bool pushAck(unsigned char c);
+   bool pushAck(const unsigned char * data, unsigned int len);
    bool pushAckBig32(unsigned long c);
    bool pushEndOfAck();
 
 private:
+   bool encodeAck(unsigned char c); //encode without updating the crc
    unsigned char _buffer[SLAY2_ACK_BUFFER];
 };
 
@@ -65,10 +92,13 @@ class Slay2DataEncodingBuffer : public Slay2Buffer
 public:
    Slay2DataEncodingBuffer() : Slay2Buffer(_buffer, sizeof(_buffer)) { };
    bool pushData(unsigned char c);
+   bool pushData(const unsigned char * data, unsigned int len);
    bool pushDataBig32(unsigned long c);
-   bool pushEndOfData();
+   bool pushEndOfData(const bool compressed = false); //terminate by an end-of-data resp. end-of-compressed-data byte
+   void setBuffer(unsigned char * const buffer, const unsigned int size); //buffer of large frames (NULL: own buffer). this implies a flush
 
 private:
+   bool encodeData(unsigned char c); //encode without updating the crc
    unsigned char _buffer[SLAY2_TX_BUFFER];
 };
 
@@ -81,6 +111,8 @@ class Slay2AckDecodingBuffer : public Slay2Buffer
 public:
    Slay2AckDecodingBuffer() : Slay2Buffer(_buffer, sizeof(_buffer)) { };
    bool pushAck(unsigned char c);
+   bool pushAck(const unsigned char * data, unsigned int len); //decode a sequence of (only) ACK bytes
+   unsigned long getCrc32(); //crc is calculated "on demand", over all decoded bytes
 
    static bool isAck(unsigned char c) { return ((c & 0xC0) == 0x40); }
    static bool isEndOfAck(unsigned char c) { return (c == SLAY2_END_OF_ACK); }
@@ -97,9 +129,14 @@ class Slay2DataDecodingBuffer : public Slay2Buffer
 public:
    Slay2DataDecodingBuffer() : Slay2Buffer(_buffer, sizeof(_buffer)) { };
    bool pushData(unsigned char c);
+   bool pushData(const unsigned char * data, unsigned int len); //decode a sequence of (only) DATA bytes
+   unsigned long getCrc32(); //crc is calculated "on demand", over all decoded bytes
+   bool isCrcValid(const bool compressed); //the crc over the whole frame (including its crc) is the residue of its type
+   void setBuffer(unsigned char * const buffer, const unsigned int size); //buffer of large frames (NULL: own buffer). this implies a flush
 
    static bool isData(unsigned char c) { return ((c & 0x80) == 0x80); }
-   static bool isEndOfData(unsigned char c) { return (c == SLAY2_END_OF_DATA); }
+   static bool isEndOfData(unsigned char c) { return (c == SLAY2_END_OF_DATA) || (c == SLAY2_END_OF_CDATA); }
+   static bool isCompressed(unsigned char c) { return (c == SLAY2_END_OF_CDATA); }
    static unsigned char decodeData(const unsigned char * buffer, unsigned int byteNumber);
 
 private:
@@ -109,26 +146,126 @@ private:
 
 
 
-//normal fifo
+//allocator of the memory of a Slay2 instance (channels, their TX buffers, the transmission window and the reorder buffer).
+//block sizes are rounded up to a power of two. released blocks are kept in a free list per size, for reuse.
+//the blocks are taken either from a static arena (SLAY2_POOL_SIZE > 0), or from the heap
+class Slay2Pool
+{
+public:
+   Slay2Pool();
+   ~Slay2Pool();
+   void * alloc(const unsigned int size); //returns NULL, if exhausted. blocks are 8-byte aligned
+   void release(void * const block);
+   static unsigned int getBlockSize(const unsigned int size); //size rounded up to a power of two
+
+private:
+   union Block //header of a block, followed by its data
+   {
+      unsigned long long align;
+      unsigned int sizeClass; //block size is 2^sizeClass
+      Block * next; //next free block of the same size
+   };
+   static unsigned int getSizeClass(const unsigned int size);
+   Block * freeList[SLAY2_POOL_CLASSES];
+#if (SLAY2_POOL_SIZE > 0)
+   unsigned long long arena[(SLAY2_POOL_SIZE + 7) / 8];
+   unsigned int arenaUsed; //number of used words of the arena
+#endif
+};
+
+
+//normal fifo. the buffer is provided by the owner, its size must be a power of two.
+//it is a lock-free single producer (push, pushN) / single consumer (pop, popN, peek, drop, flush) ring buffer:
+//the producer publishes its data by the write position, the consumer releases the space by the read position
 class Slay2Fifo
 {
 public:
    Slay2Fifo();
+   void setBuffer(unsigned char * const buffer, const unsigned int size); //this implies a flush
+   unsigned char * getBuffer();
+   unsigned int getSize();
    unsigned int getCount();
    unsigned int getSpace();
    bool push(unsigned char c);
    int pop();
+   unsigned int pushN(const unsigned char * data, unsigned int len); //returns the number of pushed bytes (limited by the space)
+   unsigned int popN(unsigned char * data, unsigned int len); //returns the number of popped bytes (limited by the count)
+   //get up to "len" bytes without popping them. due to the wrap around, they may be split into two contiguous segments
+   //(segLen[1] is 0 otherwise). returns the total length of both segments
+   unsigned int peek(const unsigned char * seg[2], unsigned int segLen[2], unsigned int len);
+   void drop(unsigned int len); //pop "len" bytes (e.g. after peek) without copying them
+   unsigned int flush(); //returns the number of dropped bytes
+
+
+private:
+   unsigned char * buffer;
+   unsigned int size;
+   unsigned int mask; //size - 1
+   std::atomic<unsigned int> read;  //free running positions (wrap around by mask). written by the consumer only...
+   std::atomic<unsigned int> write; //... resp. by the producer only. count = write - read
+};
+
+
+//queue of received payloads, to be delivered outside the critical section (deferred delivery).
+//like Slay2Fifo, a lock-free single producer (hasSpace, push) / single consumer (getReadPosition, peek, release, flush) ring
+//buffer. but it keeps records: each payload is contiguous (no wrap around) and zero terminated, like the data passed to
+//a receiver. the buffer is provided by the owner, its size must be a power of two
+class Slay2DeliveryQueue
+{
+public:
+   Slay2DeliveryQueue();
+   void setBuffer(unsigned char * const buffer, const unsigned int size); //this implies a flush
+   unsigned char * getBuffer();
+   bool isEmpty();
+   bool hasSpace(const unsigned int len); //a payload of "len" bytes can be pushed now
+   bool push(const unsigned char channel, const unsigned char * data, const unsigned int len);
+   //the consumer iterates over the records from the read position on, without releasing them. returns the payload of the
+   //record at "pos" (NULL: no more records) and moves "pos" on to the next record
+   unsigned int getReadPosition();
+   const unsigned char * peek(unsigned int * pos, unsigned char * channel, unsigned int * len);
+   void release(const unsigned int pos); //release all records before "pos"
    void flush();
 
+private:
+   static unsigned int getRecordSize(const unsigned int len); //header, payload and zero termination, 4-byte aligned
+   unsigned char * buffer;
+   unsigned int size;
+   unsigned int mask; //size - 1
+   std::atomic<unsigned int> read;  //free running positions (wrap around by mask). written by the consumer only...
+   std::atomic<unsigned int> write; //... resp. by the producer only
+};
+
+
+//reorder buffer of a selective repeat receiver.
+//keeps received frames, which are "ahead" of the next expected frame, until the gap is filled.
+//frames are addressed by their offset to the next expected frame (offset 0 is the next expected frame).
+class Slay2ReorderBuffer
+{
+public:
+   Slay2ReorderBuffer(Slay2Pool * const pool);
+   ~Slay2ReorderBuffer();
+   bool setSize(unsigned int size, unsigned int frameSize = SLAY2_RX_BUFFER); //max. number of frames (incl. the next expected one). this implies a flush
+   unsigned int getSize();
+   void flush();
+   bool put(unsigned int offset, const unsigned char * data, unsigned int len); //return false if offset out of range
+   bool isValid(unsigned int offset);
+   unsigned int getCount(); //number of frames received (out of order), but not yet popped
+   unsigned char * top(unsigned int * len); //get the frame at offset 0. return NULL if not (yet) received
+   void pop(); //drop the frame at offset 0, and move on to the next one
 
 private:
-   unsigned char buffer[SLAY2_FIFO_SIZE];
-   unsigned int read;
-   unsigned int write;
+   void release();
+   Slay2Pool * pool;
+   unsigned char * frames; //"size" frames, each of "frameSize" bytes
+   unsigned int frameSize;
+   unsigned int * lens; //length of each frame. 0 if empty
+   unsigned int size;
+   unsigned int head;
    unsigned int count;
 };
 
 
+
 //this is a special kind of fifo.
 //it does not implement a circular buffer. it is just a linear buffer!
 //at the beginning, the buffer is empty.
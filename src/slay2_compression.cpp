@@ -0,0 +1,289 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Serial Layer 2 Protocol. LZ compression of the payload of DATA frames.
+
+   A byte oriented LZ77 codec (similar to LZ4), with a dictionary that persists
+   across the frames of a channel. Frames are decompressed in order of their
+   sequence numbers, so the dictionaries of transmitter and receiver are equal.
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include "slay2_compression.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+#define SLAY2_LZ_NO_POSITION  (0xFFFFu) //empty entry of the hash table
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+//hash of the 4-byte sequence at "data"
+static inline unsigned int hash4(const unsigned char * data)
+{
+   const unsigned int value = (unsigned int)data[0] | ((unsigned int)data[1] << 8) |
+                              ((unsigned int)data[2] << 16) | ((unsigned int)data[3] << 24);
+   return (value * 2654435761u) >> (32 - SLAY2_LZ_HASH_BITS);
+}
+
+//number of additional bytes to encode a (literal or match) length field of "len"
+static inline unsigned int lengthBytes(const unsigned int len)
+{
+   return (len >= 15) ? (((len - 15) / 255) + 1) : 0;
+}
+
+//encode the additional bytes of a length field. returns the number of bytes written
+static unsigned int putLength(unsigned char * out, unsigned int len)
+{
+   unsigned int count = 0;
+   if (len >= 15)
+   {
+      len -= 15;
+      while (len >= 255)
+      {
+         out[count++] = 255;
+         len -= 255;
+      }
+      out[count++] = (unsigned char)len;
+   }
+   return count;
+}
+
+//decode the additional bytes of a length field. returns false, if the input ends before
+static bool getLength(const unsigned char * in, const unsigned int inLen, unsigned int * pos, unsigned int * len)
+{
+   unsigned char c;
+   do
+   {
+      if (*pos >= inLen)
+      {
+         return false;
+      }
+      c = in[(*pos)++];
+      *len += c;
+   } while (c == 255);
+   return true;
+}
+
+//keep the last SLAY2_LZ_HISTORY bytes of the window as dictionary. returns the number of dropped bytes
+static unsigned int slide(unsigned char * window, const unsigned int total, unsigned int * histLen)
+{
+   if (total <= SLAY2_LZ_HISTORY)
+   {
+      *histLen = total;
+      return 0;
+   }
+   const unsigned int shift = total - SLAY2_LZ_HISTORY;
+   memmove(window, &window[shift], SLAY2_LZ_HISTORY);
+   *histLen = SLAY2_LZ_HISTORY;
+   return shift;
+}
+
+
+
+
+Slay2Compressor::Slay2Compressor()
+{
+   reset();
+}
+
+void Slay2Compressor::reset()
+{
+   for (unsigned int i = 0; i < (1u << SLAY2_LZ_HASH_BITS); ++i)
+   {
+      table[i] = SLAY2_LZ_NO_POSITION;
+   }
+   histLen = 0;
+   resetPending = true;
+}
+
+unsigned int Slay2Compressor::compress(const unsigned char * const seg[2], const unsigned int segLen[2],
+                                       unsigned char * out, const unsigned int outSize, unsigned int * consumed)
+{
+   *consumed = 0;
+   if (outSize < 2)
+   {
+      return 0;
+   }
+   //copy the input behind the dictionary
+   const unsigned int len0 = (segLen[0] < SLAY2_LZ_INPUT) ? segLen[0] : SLAY2_LZ_INPUT;
+   const unsigned int len1 = (segLen[1] < (SLAY2_LZ_INPUT - len0)) ? segLen[1] : (SLAY2_LZ_INPUT - len0);
+   memcpy(&window[histLen], seg[0], len0);
+   memcpy(&window[histLen + len0], seg[1], len1);
+   const unsigned int start = histLen;
+   const unsigned int end = histLen + len0 + len1;
+
+   unsigned int op = 0;
+   out[op++] = resetPending ? SLAY2_LZ_FLAG_RESET : 0;
+   unsigned int ip = start;
+   unsigned int anchor = start; //begin of the pending literals
+   while ((ip + SLAY2_LZ_MIN_MATCH) <= end)
+   {
+      const unsigned int h = hash4(&window[ip]);
+      const unsigned int candidate = table[h];
+      table[h] = (unsigned short)ip;
+      //any position before the current one is known by the receiver (the hash table may contain outdated positions.
+      //so the bytes are compared in any case)
+      if ((candidate < ip) && (memcmp(&window[candidate], &window[ip], SLAY2_LZ_MIN_MATCH) == 0))
+      {
+         unsigned int matchLen = SLAY2_LZ_MIN_MATCH;
+         while (((ip + matchLen) < end) && (window[candidate + matchLen] == window[ip + matchLen]))
+         {
+            ++matchLen;
+         }
+         const unsigned int litLen = ip - anchor;
+         const unsigned int offset = ip - candidate;
+         const unsigned int cost = 1 + lengthBytes(litLen) + litLen + 2 + lengthBytes(matchLen - SLAY2_LZ_MIN_MATCH);
+         if ((op + cost) > outSize)
+         {
+            break; //output is full
+         }
+         //token, literals, offset, match length
+         const unsigned int litToken = (litLen < 15) ? litLen : 15;
+         const unsigned int matchToken = ((matchLen - SLAY2_LZ_MIN_MATCH) < 15) ? (matchLen - SLAY2_LZ_MIN_MATCH) : 15;
+         out[op++] = (unsigned char)((litToken << 4) | matchToken);
+         op += putLength(&out[op], litLen);
+         memcpy(&out[op], &window[anchor], litLen);
+         op += litLen;
+         out[op++] = (unsigned char)offset;
+         out[op++] = (unsigned char)(offset >> 8);
+         op += putLength(&out[op], matchLen - SLAY2_LZ_MIN_MATCH);
+         ip += matchLen;
+         anchor = ip;
+         continue;
+      }
+      ++ip;
+   }
+
+   //last sequence: literals only (as many as fit into the output)
+   unsigned int litLen = end - anchor;
+   if ((op + 1) >= outSize)
+   {
+      litLen = 0;
+   }
+   else
+   {
+      if (litLen > (outSize - op - 1))
+      {
+         litLen = outSize - op - 1;
+      }
+      while ((op + 1 + lengthBytes(litLen) + litLen) > outSize)
+      {
+         --litLen;
+      }
+   }
+   if (litLen > 0)
+   {
+      out[op++] = (unsigned char)(((litLen < 15) ? litLen : 15) << 4);
+      op += putLength(&out[op], litLen);
+      memcpy(&out[op], &window[anchor], litLen);
+      op += litLen;
+   }
+   *consumed = anchor + litLen - start;
+   return op;
+}
+
+void Slay2Compressor::commit(const unsigned int consumed)
+{
+   resetPending = false;
+   const unsigned int shift = slide(window, histLen + consumed, &histLen);
+   if (shift > 0)
+   {
+      //rebase the hash table to the new begin of the window
+      for (unsigned int i = 0; i < (1u << SLAY2_LZ_HASH_BITS); ++i)
+      {
+         table[i] = ((table[i] != SLAY2_LZ_NO_POSITION) && (table[i] >= shift)) ?
+                    (unsigned short)(table[i] - shift) : (unsigned short)SLAY2_LZ_NO_POSITION;
+      }
+   }
+}
+
+
+
+
+Slay2Decompressor::Slay2Decompressor()
+{
+   histLen = 0;
+}
+
+int Slay2Decompressor::decompress(const unsigned char * in, const unsigned int inLen, unsigned char * out)
+{
+   if (inLen < 1)
+   {
+      return -1;
+   }
+   unsigned int ip = 0;
+   if (in[ip++] & SLAY2_LZ_FLAG_RESET)
+   {
+      histLen = 0;
+   }
+   unsigned int op = histLen;
+   const unsigned int limit = histLen + SLAY2_LZ_INPUT;
+   while (ip < inLen)
+   {
+      const unsigned int token = in[ip++];
+      //literals
+      unsigned int litLen = token >> 4;
+      if ((litLen == 15) && (getLength(in, inLen, &ip, &litLen) == false))
+      {
+         return -1;
+      }
+      if ((litLen > (inLen - ip)) || (litLen > (limit - op)))
+      {
+         return -1;
+      }
+      memcpy(&window[op], &in[ip], litLen);
+      op += litLen;
+      ip += litLen;
+      if (ip >= inLen)
+      {
+         break; //last sequence
+      }
+      //match
+      if ((inLen - ip) < 2)
+      {
+         return -1;
+      }
+      const unsigned int offset = (unsigned int)in[ip] | ((unsigned int)in[ip + 1] << 8);
+      ip += 2;
+      unsigned int matchLen = token & 0x0F;
+      if ((matchLen == 15) && (getLength(in, inLen, &ip, &matchLen) == false))
+      {
+         return -1;
+      }
+      matchLen += SLAY2_LZ_MIN_MATCH;
+      if ((offset == 0) || (offset > op) || (matchLen > (limit - op)))
+      {
+         return -1;
+      }
+      //byte by byte: the match may overlap the output
+      for (unsigned int i = 0; i < matchLen; ++i, ++op)
+      {
+         window[op] = window[op - offset];
+      }
+   }
+   const unsigned int outLen = op - histLen;
+   memcpy(out, &window[histLen], outLen);
+   slide(window, op, &histLen);
+   return (int)outLen;
+}
+
+void Slay2Decompressor::append(const unsigned char * data, const unsigned int len)
+{
+   //only the last SLAY2_LZ_HISTORY bytes are kept. they are added in steps, that fit behind the dictionary
+   unsigned int pos = (len > SLAY2_LZ_HISTORY) ? (len - SLAY2_LZ_HISTORY) : 0;
+   while (pos < len)
+   {
+      const unsigned int count = ((len - pos) < SLAY2_LZ_INPUT) ? (len - pos) : SLAY2_LZ_INPUT;
+      memcpy(&window[histLen], &data[pos], count);
+      slide(window, histLen + count, &histLen);
+      pos += count;
+   }
+}
@@ -0,0 +1,87 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Serial Layer 2 Protocol. LZ compression of the payload of DATA frames.
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef SLAY2_COMPRESSION_H
+#define SLAY2_COMPRESSION_H
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include "slay2_buffer.h"
+
+/* -- Defines ------------------------------------------------------------- */
+#ifndef SLAY2_LZ_HISTORY
+ #define SLAY2_LZ_HISTORY     (2048) //dictionary: number of bytes of previous (compressed) frames, a match may refer to
+#endif
+#define SLAY2_LZ_INPUT        (1024) //max. number of (uncompressed) bytes of a compressed frame
+#define SLAY2_LZ_WINDOW       (SLAY2_LZ_HISTORY + SLAY2_LZ_INPUT)
+#define SLAY2_LZ_HASH_BITS    (11)
+#define SLAY2_LZ_MIN_MATCH    (4)
+
+#define SLAY2_LZ_FLAG_RESET   (0x01) //header flag of a compressed frame: the dictionary is reset before decompression
+
+/* -- Types --------------------------------------------------------------- */
+
+/*
+   Compressed payload (transmitted by a DATA frame, that is terminated by an end-of-compressed-data byte):
+      +--------+----------+-----+----------+
+      | HEADER | SEQUENCE | ... | SEQUENCE |
+      +--------+----------+-----+----------+
+   -- header: flags (SLAY2_LZ_FLAG_RESET)
+   -- sequence: token, [literal length], literals, [offset (2 bytes, little endian), [match length]]
+      token: bit[7:4] literal length, bit[3:0] match length - 4. 15 is continued by further length bytes (each
+      added, until a byte is less than 255). the last sequence consists of literals only.
+   Matches may refer to the current frame and to the dictionary: the last SLAY2_LZ_HISTORY bytes of the payload of
+   the channel, including raw frames (which are sent, if compression does not pay off). The first frame after a reset
+   is always compressed, so the receiver knows, when to start its dictionary.
+*/
+
+
+//compressor of the transmitter of a channel
+class Slay2Compressor
+{
+public:
+   Slay2Compressor();
+   void reset(); //the next frame resets the dictionary of the receiver
+   //compress up to SLAY2_LZ_INPUT bytes of (up to two) segments into "out" (max. "outSize" bytes).
+   //returns the size of the compressed data. "consumed" returns the number of compressed input bytes
+   unsigned int compress(const unsigned char * const seg[2], const unsigned int segLen[2],
+                         unsigned char * out, const unsigned int outSize, unsigned int * consumed);
+   void commit(const unsigned int consumed); //the frame is transmitted -> add its (raw) input to the dictionary (max. the input of compress())
+   bool isResetPending() {return resetPending;}
+
+private:
+   unsigned char window[SLAY2_LZ_WINDOW]; //dictionary, followed by the current input
+   unsigned short table[1 << SLAY2_LZ_HASH_BITS]; //position of the last occurrence of a 4-byte sequence
+   unsigned int histLen;
+   bool resetPending;
+};
+
+
+//decompressor of the receiver of a channel
+class Slay2Decompressor
+{
+public:
+   Slay2Decompressor();
+   //returns the size of the decompressed data (max. SLAY2_LZ_INPUT bytes), or -1 on corrupted data.
+   //the decompressed data is added to the dictionary
+   int decompress(const unsigned char * in, const unsigned int inLen, unsigned char * out);
+   void append(const unsigned char * data, const unsigned int len); //add the payload of a raw frame to the dictionary
+
+private:
+   unsigned char window[SLAY2_LZ_WINDOW]; //dictionary, followed by the current output
+   unsigned int histLen;
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif
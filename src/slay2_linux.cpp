@@ -14,14 +14,40 @@
 #include <termios.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
 #include "slay2_linux.h"
 #include "slay2_buffer.h"
 
 
 /* -- Defines ------------------------------------------------------------- */
+//arbitrary baudrates (termios2). glibc does not provide its declaration, and <asm/termbits.h> conflicts with <termios.h>
+#ifndef BOTHER
+ #define BOTHER   (0010000) //c_cflag: the speed is given by c_ispeed/c_ospeed
+#endif
+#ifndef IBSHIFT
+ #define IBSHIFT  (16)      //c_cflag: shift of the input baudrate
+#endif
 
 /* -- Types --------------------------------------------------------------- */
+#ifdef TCGETS2
+//same layout as the termios2 structure of the kernel (asm-generic/termbits.h)
+struct termios2
+{
+   tcflag_t c_iflag;
+   tcflag_t c_oflag;
+   tcflag_t c_cflag;
+   tcflag_t c_lflag;
+   cc_t c_line;
+   cc_t c_cc[19];
+   speed_t c_ispeed;
+   speed_t c_ospeed;
+};
+#endif
 
 /* -- (Module) Global Variables ------------------------------------------- */
 
@@ -33,19 +59,37 @@
 Slay2Linux::Slay2Linux()
 {
    fileDesc = -1;
+   vmin = SLAY2_LINUX_VMIN;
+   vtime = SLAY2_LINUX_VTIME;
+   lowLatency = true;
+   running = false;
+   criticalDepth = 0;
+   rxEvents = 0;
+   epollFd = -1;
+   eventFd = -1;
+   timerFd = -1;
 
    //initialize a recursive mutex for critical section handling
    pthread_mutexattr_t mutexAttr;
    pthread_mutexattr_init(&mutexAttr);
    pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_RECURSIVE);
    pthread_mutex_init(&mutex, &mutexAttr);
+   //blocking reads wait on their own mutex. a condition variable can't release a recursive mutex, that is owned more than once
+   pthread_mutex_init(&rxMutex, NULL);
+   //the timeout of blocking reads is not affected by changes of the system time
+   pthread_condattr_t condAttr;
+   pthread_condattr_init(&condAttr);
+   pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+   pthread_cond_init(&rxCond, &condAttr);
 }
 
 
 Slay2Linux::~Slay2Linux()
 {
+   shutdown(); //this stops the I/O thread, before the mutex is destroyed
+   pthread_cond_destroy(&rxCond);
+   pthread_mutex_destroy(&rxMutex);
    pthread_mutex_destroy(&mutex);
-   shutdown();
 }
 
 
@@ -54,7 +98,12 @@ bool Slay2Linux::init(const char * dev, const unsigned int baudrate)
    fileDesc = ::open(dev, O_RDWR | O_NOCTTY); //using "::open" to "say" that the global "open" function is meant, not the "open" method of this class.
    if (fileDesc >= 0)
    {
-      setInterfaceAttribs(baudrate); //configure interface
+      if (setInterfaceAttribs(baudrate) != 0) //configure interface
+      {
+         shutdown(); //e.g. baudrate not supported by the driver
+         return false;
+      }
+      setBaudrate(baudrate); //scale the timeouts and the pacing of the transmitter
       flush(); //drop all data in input and output buffer
       return true;
    }
@@ -64,6 +113,7 @@ bool Slay2Linux::init(const char * dev, const unsigned int baudrate)
 
 void Slay2Linux::shutdown(void)
 {
+   stop();
    if (fileDesc >= 0)
    {
       ::close(fileDesc); //using "::close" to "say" that the global "close" function is meant, not the "close" method of this class.
@@ -72,6 +122,153 @@ void Slay2Linux::shutdown(void)
 }
 
 
+//VMIN: min. number of bytes, that wake up a reader (resp. the I/O thread, if VTIME is 0). this allows to receive in bigger blocks.
+//VTIME: timeout [100ms] of a blocking read. both 0 (default): non-blocking read
+void Slay2Linux::setReadTimeout(const unsigned char vmin, const unsigned char vtime)
+{
+   this->vmin = vmin;
+   this->vtime = vtime;
+}
+
+
+void Slay2Linux::setLowLatency(const bool enable)
+{
+   lowLatency = enable;
+}
+
+
+//start the event-driven operation. the I/O thread only runs, if data is sent (eventFd) or received (tty),
+//if the tty drained its TX buffer, or at the next deadline of the protocol (timerFd)
+bool Slay2Linux::start(void)
+{
+   if ((fileDesc < 0) || running)
+   {
+      return false;
+   }
+   epollFd = epoll_create1(EPOLL_CLOEXEC);
+   eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   bool success = (epollFd >= 0) && (eventFd >= 0) && (timerFd >= 0);
+   if (success)
+   {
+      struct epoll_event event;
+      memset(&event, 0, sizeof(event));
+      //edge triggered: task() reads all the input. and the I/O thread shall not spin, while the tty is writable
+      event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+      event.data.fd = fileDesc;
+      success = success && (epoll_ctl(epollFd, EPOLL_CTL_ADD, fileDesc, &event) == 0);
+      event.events = EPOLLIN;
+      event.data.fd = eventFd;
+      success = success && (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event) == 0);
+      event.data.fd = timerFd;
+      success = success && (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event) == 0);
+   }
+   if (success)
+   {
+      //the I/O thread must never block in read/write
+      fcntl(fileDesc, F_SETFL, fcntl(fileDesc, F_GETFL) | O_NONBLOCK);
+      running = true;
+      success = (pthread_create(&thread, NULL, &Slay2Linux::ioThread, this) == 0);
+      running = success;
+   }
+   if (success == false)
+   {
+      stop();
+   }
+   return success;
+}
+
+
+void Slay2Linux::stop(void)
+{
+   if (running)
+   {
+      running = false;
+      notify(); //wake up the I/O thread
+      pthread_join(thread, NULL);
+      notifyReceived(); //blocking reads return, as nobody would wake them up anymore
+   }
+   if (epollFd >= 0)
+   {
+      ::close(epollFd);
+      epollFd = -1;
+   }
+   if (eventFd >= 0)
+   {
+      ::close(eventFd);
+      eventFd = -1;
+   }
+   if (timerFd >= 0)
+   {
+      ::close(timerFd);
+      timerFd = -1;
+   }
+   if (fileDesc >= 0)
+   {
+      fcntl(fileDesc, F_SETFL, fcntl(fileDesc, F_GETFL) & ~O_NONBLOCK);
+   }
+}
+
+
+//new data was sent -> wake up the I/O thread
+void Slay2Linux::notify(void)
+{
+   if (eventFd >= 0)
+   {
+      const uint64_t one = 1;
+      if (::write(eventFd, &one, sizeof(one)) < 0)
+      {
+         //counter overflow: the I/O thread is woken up anyway
+      }
+   }
+}
+
+
+void * Slay2Linux::ioThread(void * obj)
+{
+   ((Slay2Linux *)obj)->runIo();
+   return NULL;
+}
+
+
+void Slay2Linux::runIo(void)
+{
+   struct epoll_event events[3];
+
+   while (running)
+   {
+      task();
+
+      //sleep until something happens, but at most until the next deadline of the protocol
+      const unsigned int idle = getIdleTime();
+      if (idle == 0)
+      {
+         continue; //there is more to do
+      }
+      struct itimerspec timer;
+      memset(&timer, 0, sizeof(timer)); //0: disarm the timer
+      if (idle != SLAY2_NO_DEADLINE)
+      {
+         timer.it_value.tv_sec = idle / 1000u;
+         timer.it_value.tv_nsec = (idle % 1000u) * 1000000L;
+      }
+      timerfd_settime(timerFd, 0, &timer, NULL);
+      const int count = epoll_wait(epollFd, events, sizeof(events) / sizeof(events[0]), -1);
+      for (int i = 0; i < count; ++i)
+      {
+         if ((events[i].data.fd == eventFd) || (events[i].data.fd == timerFd))
+         {
+            uint64_t value;
+            if (::read(events[i].data.fd, &value, sizeof(value)) < 0)
+            {
+               //already consumed
+            }
+         }
+      }
+   }
+}
+
+
 unsigned int Slay2Linux::getTime1ms(void)
 {
    static unsigned int startSecond;
@@ -98,17 +295,77 @@ unsigned int Slay2Linux::getTime1ms(void)
 }
 
 
+//monotonic time in microseconds (wraps around). used for the statistics
+unsigned int Slay2Linux::getTime1us(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (unsigned int)((unsigned long long)now.tv_sec * 1000000u + (unsigned long long)now.tv_nsec / 1000u);
+}
+
+
 void Slay2Linux::enterCritical(void)
 {
    pthread_mutex_lock(&mutex);
+   ++criticalDepth;
 }
 
 void Slay2Linux::leaveCritical(void)
 {
+   --criticalDepth;
    pthread_mutex_unlock(&mutex);
 }
 
 
+//the caller owns the mutex once. it is released while waiting for notifyReceived()
+bool Slay2Linux::waitReceived(const unsigned int timeout1ms)
+{
+   //nobody would wake me up: the mutex would still be owned (e.g. within a receiver), or this is the I/O thread itself.
+   //without the I/O thread, the caller runs task() itself, and just pauses here (see Slay2::waitEvent)
+   if ((criticalDepth != 1) || (running && pthread_equal(pthread_self(), thread)))
+   {
+      return false;
+   }
+   struct timespec deadline;
+   clock_gettime(CLOCK_MONOTONIC, &deadline);
+   deadline.tv_sec += timeout1ms / 1000u;
+   deadline.tv_nsec += (timeout1ms % 1000u) * 1000000L;
+   if (deadline.tv_nsec >= 1000000000L)
+   {
+      deadline.tv_nsec -= 1000000000L;
+      ++deadline.tv_sec;
+   }
+   //the rxMutex is taken, before the mutex is released: notifyReceived() of the I/O thread can't get lost meanwhile
+   pthread_mutex_lock(&rxMutex);
+   const unsigned int events = rxEvents;
+   leaveCritical();
+   int result = 0;
+   while ((rxEvents == events) && (result == 0))
+   {
+      result = pthread_cond_timedwait(&rxCond, &rxMutex, &deadline);
+   }
+   const bool notified = (rxEvents != events);
+   pthread_mutex_unlock(&rxMutex);
+   enterCritical();
+   return notified;
+}
+
+
+bool Slay2Linux::hasTaskThread(void)
+{
+   return running;
+}
+
+
+void Slay2Linux::notifyReceived(void)
+{
+   pthread_mutex_lock(&rxMutex);
+   ++rxEvents;
+   pthread_cond_broadcast(&rxCond);
+   pthread_mutex_unlock(&rxMutex);
+}
+
+
 unsigned int Slay2Linux::getTxCount(void)
 {
    unsigned int count = 0;
@@ -236,37 +493,120 @@ int Slay2Linux::setInterfaceAttribs(unsigned int baudrate)
    );
 
    //set timeout behaviour (wait up to TIME*100ms while RX buffer is empty (MIN=0))
-   tty.c_cc[VMIN]  = 0;
-   tty.c_cc[VTIME] = 0;   //wait 0*100ms -> do not wait -> non-blocking read
+   tty.c_cc[VMIN]  = vmin;  //default 0
+   tty.c_cc[VTIME] = vtime; //default: wait 0*100ms -> do not wait -> non-blocking read
 
-   //adjust baudrate
-   int speed = (int)encodeBaudrate(baudrate);
-   cfsetspeed (&tty, speed); //set input and output speed to same baudrate
+   //adjust baudrate. a non-standard baudrate is set afterwards (termios2)
+   const unsigned int speed = encodeBaudrate(baudrate);
+   cfsetspeed (&tty, (speed != B0) ? speed : B38400); //set input and output speed to same baudrate
 
    //write back the modified  settings
    if (tcsetattr (fd, TCSANOW, &tty) != 0)
    {
       return -1;
    }
+   if ((speed == B0) && (setCustomBaudrate(baudrate) != 0))
+   {
+      return -1;
+   }
+
+   //low latency: the driver passes received data to the tty immediately (instead of collecting it for some ms).
+   //not supported by all drivers (e.g. pseudo terminals) -> ignore errors
+   struct serial_struct serial;
+   if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+   {
+      if (lowLatency)
+      {
+         serial.flags |= ASYNC_LOW_LATENCY;
+      }
+      else
+      {
+         serial.flags &= ~ASYNC_LOW_LATENCY;
+      }
+      ioctl(fd, TIOCSSERIAL, &serial);
+   }
    return 0;
 }
 
 
-//currently there is only a subset of baudrates supported!
+//standard baudrates. returns B0 for any other baudrate (see setCustomBaudrate)
 unsigned int Slay2Linux::encodeBaudrate(unsigned int baudrate)
 {
    switch (baudrate)
    {
-      case 2400:   return B2400;
-      case 4800:   return B4800;
-      case 9600:   return B9600;
-      case 19200:  return B19200;
-      case 38400:  return B38400;
-      case 57600:  return B57600;
-      case 115200: return B115200;
-      default:     break;
+      case 1200:    return B1200;
+      case 1800:    return B1800;
+      case 2400:    return B2400;
+      case 4800:    return B4800;
+      case 9600:    return B9600;
+      case 19200:   return B19200;
+      case 38400:   return B38400;
+      case 57600:   return B57600;
+      case 115200:  return B115200;
+#ifdef B230400
+      case 230400:  return B230400;
+#endif
+#ifdef B460800
+      case 460800:  return B460800;
+#endif
+#ifdef B500000
+      case 500000:  return B500000;
+#endif
+#ifdef B576000
+      case 576000:  return B576000;
+#endif
+#ifdef B921600
+      case 921600:  return B921600;
+#endif
+#ifdef B1000000
+      case 1000000: return B1000000;
+#endif
+#ifdef B1152000
+      case 1152000: return B1152000;
+#endif
+#ifdef B1500000
+      case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+      case 2000000: return B2000000;
+#endif
+#ifdef B2500000
+      case 2500000: return B2500000;
+#endif
+#ifdef B3000000
+      case 3000000: return B3000000;
+#endif
+#ifdef B3500000
+      case 3500000: return B3500000;
+#endif
+#ifdef B4000000
+      case 4000000: return B4000000;
+#endif
+      default:      break;
+   }
+   return B0; //no standard baudrate
+}
+
+
+//arbitrary baudrate (e.g. 250000, or 3 Mbaud on a system without B3000000), set by termios2 (BOTHER).
+//the driver picks the nearest baudrate it is able to generate
+int Slay2Linux::setCustomBaudrate(unsigned int baudrate)
+{
+#ifdef TCGETS2
+   struct termios2 tio;
+   if (ioctl(this->fileDesc, TCGETS2, &tio) != 0)
+   {
+      return -1;
    }
-   return B0; //hang up
+   tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+   tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT); //output and input speed
+   tio.c_ospeed = baudrate;
+   tio.c_ispeed = baudrate;
+   return ioctl(this->fileDesc, TCSETS2, &tio);
+#else
+   (void)baudrate;
+   return -1; //not supported
+#endif
 }
 
 
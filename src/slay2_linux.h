@@ -9,9 +9,16 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <pthread.h>
+#include <atomic>
 #include "slay2.h"
 
 /* -- Defines ------------------------------------------------------------- */
+#ifndef SLAY2_LINUX_VMIN
+ #define SLAY2_LINUX_VMIN   (0) //default VMIN of the tty: min. number of bytes, that wake up a reader (0: any)
+#endif
+#ifndef SLAY2_LINUX_VTIME
+ #define SLAY2_LINUX_VTIME  (0) //default VTIME of the tty: read timeout [100ms] (0: non-blocking read)
+#endif
 
 /* -- Types --------------------------------------------------------------- */
 class Slay2Linux : public Slay2
@@ -19,10 +26,24 @@ class Slay2Linux : public Slay2
 public:
    Slay2Linux();
    ~Slay2Linux();
-   bool init(const char * dev, const unsigned int baudrate); //for baudrates slower than 115k2 the "SLAY2_TRANSMISSION_TIMEOUT" value must probably be adjusted (via global preprocessor define!!!)
+   bool init(const char * dev, const unsigned int baudrate); //any baudrate (non-standard ones by termios2). timeouts are adapted to it
    void shutdown(void);
+   void setReadTimeout(const unsigned char vmin, const unsigned char vtime); //VMIN/VTIME of the tty. to be called before init()
+   void setLowLatency(const bool enable); //ASYNC_LOW_LATENCY of the serial driver (enabled by default). to be called before init()
+
+   //event-driven operation: an I/O thread calls task(), whenever data was sent or received, or a timeout expired.
+   //the application must not call task() itself, while the I/O thread is running. receivers are called by the I/O thread
+   bool start(void); //to be called after init()
+   void stop(void);
+   void notify(void);
+   //blocking read of RX rings and flushAndWait(). while the I/O thread is running, they wait for it (in other threads
+   //only, not in receivers). otherwise they run task() themselves (see Slay2::hasTaskThread)
+   bool waitReceived(const unsigned int timeout1ms);
+   void notifyReceived(void);
+   bool hasTaskThread(void);
 
    unsigned int getTime1ms(void);
+   unsigned int getTime1us(void);
 
    void enterCritical(void);
    void leaveCritical(void);
@@ -36,10 +57,25 @@ public:
 private:
    int setInterfaceAttribs(unsigned int baudrate);
    unsigned int encodeBaudrate(unsigned int baudrate);
+   int setCustomBaudrate(unsigned int baudrate);
    void flush(void);
+   static void * ioThread(void * obj);
+   void runIo(void);
 
    int fileDesc;
    pthread_mutex_t mutex;
+   unsigned int criticalDepth; //number of nested enterCritical() of the owner of the mutex
+   pthread_mutex_t rxMutex; //non-recursive. guards rxEvents
+   pthread_cond_t rxCond; //signals data put into an RX ring, or received acknowledges (uses the rxMutex)
+   unsigned int rxEvents; //counts the calls of notifyReceived()
+   unsigned char vmin;
+   unsigned char vtime;
+   bool lowLatency;
+   pthread_t thread; //I/O thread
+   std::atomic<bool> running; //cleared by stop(), polled by the I/O thread
+   int epollFd; //waits for the tty, the eventFd and the timerFd
+   int eventFd; //signals new data to be sent
+   int timerFd; //expires at the next deadline of the protocol (e.g. retransmission timeout)
 };
 
 
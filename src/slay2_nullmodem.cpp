@@ -28,6 +28,206 @@ unsigned int Slay2Nullmodem::time1ms;
 /* -- Implementation ------------------------------------------------------ */
 
 
+Slay2Line::Slay2Line()
+{
+   read = 0;
+   count = 0;
+   setImpairment(NULL);
+}
+
+
+void Slay2Line::setImpairment(const Slay2Impairment * const impairment)
+{
+   if (impairment != NULL)
+   {
+      this->impairment = *impairment;
+   }
+   else
+   {
+      memset(&this->impairment, 0, sizeof(this->impairment));
+   }
+   rng = (this->impairment.seed != 0) ? this->impairment.seed : 1u;
+   burstBits = 0;
+   busyUntil1us = 0;
+   nextError();
+}
+
+const Slay2Impairment * Slay2Line::getImpairment(void)
+{
+   return &impairment;
+}
+
+
+//xorshift32: fast, and independent of rand() of the application
+unsigned int Slay2Line::random(void)
+{
+   rng ^= rng << 13;
+   rng ^= rng >> 17;
+   rng ^= rng << 5;
+   return rng;
+}
+
+double Slay2Line::uniform(void)
+{
+   return (random() + 1.0) / 4294967296.0;
+}
+
+
+//the distance between two error events is geometrically distributed. so the random number generator is called once
+//per error event, not for each bit
+void Slay2Line::nextError(void)
+{
+   if (impairment.bitErrorRate <= 0.0)
+   {
+      bitsToError = ~0uLL; //never
+   }
+   else if (impairment.bitErrorRate >= 1.0)
+   {
+      bitsToError = 0;
+   }
+   else
+   {
+      bitsToError = (unsigned long long)floor(log(uniform()) / log(1.0 - impairment.bitErrorRate));
+   }
+}
+
+
+//flip the bits of a byte, hit by an error event
+unsigned char Slay2Line::corrupt(unsigned char c)
+{
+   if ((burstBits == 0) && (bitsToError >= 8))
+   {
+      bitsToError -= 8; //fast path: no error within this byte
+      return c;
+   }
+   for (unsigned int bit = 0; bit < 8; ++bit)
+   {
+      if (burstBits > 0)
+      {
+         --burstBits;
+         if ((burstBits == 0) || (random() & 0x100)) //the last bit of a burst is always flipped
+         {
+            c ^= (unsigned char)(1u << bit);
+         }
+         if (burstBits == 0)
+         {
+            nextError();
+         }
+      }
+      else if (bitsToError == 0)
+      {
+         c ^= (unsigned char)(1u << bit); //first bit of an error event
+         burstBits = (impairment.burstLength > 1) ? (impairment.burstLength - 1) : 0;
+         if (burstBits == 0)
+         {
+            nextError();
+         }
+      }
+      else
+      {
+         --bitsToError;
+      }
+   }
+   return c;
+}
+
+
+//put a byte on the line. returns false, if the line is full
+bool Slay2Line::put(const unsigned char c, const unsigned long long arrival1us)
+{
+   if (count >= SLAY2_NULLMODEM_LINE)
+   {
+      return false;
+   }
+   const unsigned int index = (read + count) & (SLAY2_NULLMODEM_LINE - 1);
+   data[index] = c;
+   this->arrival1us[index] = arrival1us;
+   ++count;
+   return true;
+}
+
+
+unsigned int Slay2Line::getTxCount(const unsigned long long now1us)
+{
+   if (impairment.baudrate == 0)
+   {
+      return count;
+   }
+   const unsigned int byteTime1us = (10u * 1000000u) / impairment.baudrate;
+   return (busyUntil1us > now1us) ? (unsigned int)((busyUntil1us - now1us + byteTime1us - 1) / byteTime1us) : 0;
+}
+
+int Slay2Line::transmit(const unsigned char * data, unsigned int len, const unsigned long long now1us)
+{
+   const unsigned int byteTime1us = (impairment.baudrate > 0) ? ((10u * 1000000u) / impairment.baudrate) : 0;
+   int count;
+   //write data
+   for (count = 0; count < (int)len; ++count)
+   {
+      //each byte (even a lost one) occupies the line for one byte time
+      if (this->count >= SLAY2_NULLMODEM_LINE)
+      {
+         break;
+      }
+      busyUntil1us = ((busyUntil1us > now1us) ? busyUntil1us : now1us) + byteTime1us;
+      const unsigned long long arrival1us = busyUntil1us + 1000uLL * impairment.delay1ms;
+      const unsigned char c = corrupt(*data++);
+      if ((impairment.dropRate > 0.0) && (uniform() <= impairment.dropRate))
+      {
+         continue;
+      }
+      put(c, arrival1us);
+      if ((impairment.duplicateRate > 0.0) && (uniform() <= impairment.duplicateRate))
+      {
+         put(c, arrival1us);
+      }
+   }
+   return count;
+}
+
+
+unsigned int Slay2Line::getCount(void)
+{
+   return count;
+}
+
+int Slay2Line::receive(unsigned char * buffer, unsigned int size, const unsigned long long now1us)
+{
+   int received = 0;
+   while ((size-- > 0) && (count > 0) && (arrival1us[read] <= now1us))
+   {
+      *buffer++ = data[read];
+      read = (read + 1) & (SLAY2_NULLMODEM_LINE - 1);
+      --count;
+      ++received;
+   }
+   return received;
+}
+
+
+unsigned long long Slay2Line::getNextArrival1us(const bool control)
+{
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      const unsigned int index = (read + i) & (SLAY2_NULLMODEM_LINE - 1);
+      //neither a DATA (bit[7] = 1) nor an ACK byte (bit[7:6] = 0b01)
+      if ((control == false) || ((data[index] & 0xC0) == 0))
+      {
+         return arrival1us[index];
+      }
+   }
+   return SLAY2_LINE_NO_EVENT;
+}
+
+
+
+
+Slay2Nullmodem::Slay2Nullmodem()
+{
+   remote = this;
+}
+
+
 bool Slay2Nullmodem::init(void)
 {
    //nothing todo here
@@ -40,6 +240,22 @@ void Slay2Nullmodem::shutdown(void)
 }
 
 
+void Slay2Nullmodem::setImpairment(const Slay2Impairment * const impairment)
+{
+   line.setImpairment(impairment);
+   if ((impairment != NULL) && (impairment->baudrate > 0))
+   {
+      setBaudrate(impairment->baudrate); //timing model of the protocol
+   }
+}
+
+
+void Slay2Nullmodem::connect(Slay2Nullmodem * const remote)
+{
+   this->remote = (remote != NULL) ? remote : this;
+}
+
+
 unsigned int Slay2Nullmodem::getTime1ms(void)
 {
    return Slay2Nullmodem::time1ms++;
@@ -59,59 +275,24 @@ void Slay2Nullmodem::leaveCritical(void)
 
 unsigned int Slay2Nullmodem::getTxCount(void)
 {
-   return fifo.getCount();
+   return line.getTxCount(1000uLL * time1ms);
 }
 
 int Slay2Nullmodem::transmit(const unsigned char * data, unsigned int len)
 {
-   bool success;
-   int count;
-   //write data
-   for (count = 0; count < len; ++count)
-   {
-      unsigned char c = *data++;
-#if 0
-      //randomly inject errors
-      if ((rand() % 10000) == 500) //error probability: 1:10000
-      {
-         const unsigned char old = c;
-         const unsigned char toggle = (unsigned char)(rand() & 0xFF);
-         c ^= toggle;
-         cout << "Injecting error into ";
-         if (Slay2AckDecodingBuffer::isAck(old)) cout << "ACK byte" << endl;
-         if (Slay2AckDecodingBuffer::isEndOfAck(old)) cout << "END-OF-ACK byte" << endl;
-         if (Slay2DataDecodingBuffer::isData(old)) cout << "DATA byte" << endl;
-         if (Slay2DataDecodingBuffer::isEndOfData(old)) cout << "END-OF-DATA byte" << endl;
-         printf("0x%02X XOR 0x%02X -> 0x%02X\n\n", old, toggle, c);
-      }
-#endif
-      //push into transmitter
-      success = fifo.push(c);
-      if (success == false)
-      {
-         break;
-      }
-   }
-   return count;
+   return line.transmit(data, len, 1000uLL * time1ms);
 }
 
 
 unsigned int Slay2Nullmodem::getRxCount(void)
 {
-   return fifo.getCount();
+   return remote->line.getCount();
 }
 
 int Slay2Nullmodem::receive(unsigned char * buffer, unsigned int size)
 {
-   int count = 0;
-   int c;
-   //read data
-   while ((size-- > 0) && ((c = fifo.pop()) >= 0))
-   {
-      *buffer++ = (unsigned char)c;
-      ++count;
-   }
-   return count;
+   //read the bytes of the remote transmitter, that arrived yet
+   return remote->line.receive(buffer, size, 1000uLL * time1ms);
 }
 
 
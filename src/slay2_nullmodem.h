@@ -11,15 +11,71 @@
 #include "slay2.h"
 
 /* -- Defines ------------------------------------------------------------- */
+#define SLAY2_NULLMODEM_LINE  (4096) //max. number of bytes on the line (TX buffer and in flight). power of two
+#define SLAY2_LINE_NO_EVENT   (~0uLL) //arrival time, if there is no byte on the line
 
 /* -- Types --------------------------------------------------------------- */
+
+//impairments of the line (of one direction). all zero: an ideal line (each byte is received immediately)
+struct Slay2Impairment
+{
+   unsigned int baudrate;    //bandwidth of the line [baud], 10 bits per byte (8N1). 0: unlimited
+   unsigned int delay1ms;    //propagation delay [ms]
+   double bitErrorRate;      //probability of an error event per bit
+   unsigned int burstLength; //length of an error event [bits]: its first and last bit are flipped, the bits in between
+                             //with a probability of 50%. 0, 1: single bit errors
+   double dropRate;          //probability, that a byte is lost
+   double duplicateRate;     //probability, that a byte is received twice
+   unsigned int seed;        //of the random number generator. the same seed reproduces the same errors
+};
+
+
+//one direction of a serial line: the TX buffer of the driver, and the bytes in flight.
+//times are given by the user (virtual time, in microseconds)
+class Slay2Line
+{
+public:
+   Slay2Line();
+   void setImpairment(const Slay2Impairment * const impairment); //NULL: ideal line
+   const Slay2Impairment * getImpairment(void);
+   unsigned int getTxCount(const unsigned long long now1us); //number of bytes, not yet transmitted (ideal line: not yet received)
+   int transmit(const unsigned char * data, unsigned int len, const unsigned long long now1us);
+   unsigned int getCount(void); //number of bytes on the line
+   int receive(unsigned char * buffer, unsigned int size, const unsigned long long now1us); //bytes arrived until now
+   //arrival time of the next byte. if "control", of the next control byte (SYNC or end of frame), that makes the receiver
+   //act. SLAY2_LINE_NO_EVENT: none
+   unsigned long long getNextArrival1us(const bool control);
+
+private:
+   unsigned int random(void);
+   double uniform(void); //0 < x <= 1
+   void nextError(void);
+   unsigned char corrupt(unsigned char c);
+   bool put(const unsigned char c, const unsigned long long arrival1us);
+
+   Slay2Impairment impairment;
+   unsigned int rng;
+   unsigned long long bitsToError; //number of bits until the next error event
+   unsigned int burstBits; //remaining bits of the current error event
+   unsigned long long busyUntil1us; //the last byte passed to the line is transmitted at this time
+   unsigned char data[SLAY2_NULLMODEM_LINE]; //ring buffer of the bytes on the line...
+   unsigned long long arrival1us[SLAY2_NULLMODEM_LINE]; //... and the time, they are received by the remote endpoint
+   unsigned int read;
+   unsigned int count;
+};
+
+
 class Slay2Nullmodem : public Slay2
 {
 public:
+   Slay2Nullmodem();
    bool init(void);
    void shutdown(void);
+   void setImpairment(const Slay2Impairment * const impairment); //of the transmitted bytes. NULL: ideal line
+   //receive the bytes transmitted by "remote" (two endpoints, one line per direction). NULL: by myself (loopback)
+   void connect(Slay2Nullmodem * const remote);
 
-   unsigned int getTime1ms(void);
+   unsigned int getTime1ms(void); //virtual time. each call advances it by 1 ms
 
    void enterCritical(void);
    void leaveCritical(void);
@@ -32,7 +88,8 @@ protected: //only for testing purpose, the following functions shall be public
 
 private:
    static unsigned int time1ms; //time is common for all instances
-   Slay2Fifo fifo;
+   Slay2Nullmodem * remote; //transmitter of my received bytes
+   Slay2Line line; //my transmitted bytes
 };
 
 
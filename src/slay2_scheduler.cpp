@@ -9,6 +9,7 @@
 
 /* -- Includes ------------------------------------------------------------ */
 // #include <iostream>
+#include <new>
 #include "slay2_scheduler.h"
 #include "slay2.h"
 
@@ -16,14 +17,6 @@
 /* -- Defines ------------------------------------------------------------- */
 // using namespace std;
 
-#ifndef SLAY2_TRANSMISSION_TIMEOUT
- #define SLAY2_TRANSMISSION_TIMEOUT     (60)   //set default transmission timeout:
-                                                //transmission of 300 bytes (max length of a data frame) takes ~27ms at 115k, 8N1
-                                                //timeout is 27ms for transmission
-                                                //         + 27ms for to complete a ongoing transmission on the "reply channel"
-                                                //         +  6ms generous timeout for the reply of the ACK frame
-#endif
-
 /* -- Types --------------------------------------------------------------- */
 
 /* -- (Module) Global Variables ------------------------------------------- */
@@ -32,182 +25,787 @@
 
 /* -- Implementation ------------------------------------------------------ */
 
-Slay2TxScheduler::Slay2TxScheduler()
+Slay2TxScheduler::Slay2TxScheduler(Slay2Pool * const pool, Slay2Stats * const stats, const unsigned int windowSize)
+{
+   this->pool = pool;
+   this->stats = stats;
+   this->dataFifo = NULL;
+   this->frameBuffers = NULL;
+   this->dataFifoHead = 0;
+   this->dataFifoCount = 0;
+   this->windowSize = 0;
+   this->maxFramePayload = SLAY2_FRAME_PAYLOAD;
+   this->framePayload = SLAY2_FRAME_PAYLOAD;
+   this->selectiveRepeat = false;
+   this->cumAckDelay = SLAY2_ACK_DELAY;
+   this->baudrate = SLAY2_DEFAULT_BAUDRATE;
+   this->rttValid = false;
+   this->srtt8 = 0;
+   this->rttvar4 = 0;
+   this->backoff = 0;
+   this->policy = SLAY2_STRICT_PRIORITY;
+   this->drrChannel = 0;
+   this->drrQuantumAdded = false;
+   if (setWindowSize(windowSize) == false)
+   {
+      setWindowSize(SLAY2_SCHEDULER_FIFO_DEPTH);
+   }
+}
+
+
+Slay2TxScheduler::~Slay2TxScheduler()
+{
+   pool->release(dataFifo); //frames are trivially destructible
+   pool->release(frameBuffers);
+}
+
+
+bool Slay2TxScheduler::setWindowSize(const unsigned int windowSize)
 {
-   //init data and ack frame fifo
-   for (int i = 0; i < SLAY2_SCHEDULER_FIFO_DEPTH; ++i)
+   if ((windowSize < 1) || (windowSize > SLAY2_SCHEDULER_MAX_WINDOW) || (allocate(windowSize, maxFramePayload) == false))
    {
-      dataFifo[i] = &_dataBuffer[i];
-      ackFifo[i]  = &_ackBuffer[i];
+      return false;
    }
    reset();
+   return true;
+}
+
+
+bool Slay2TxScheduler::setMaxFramePayload(const unsigned int maxPayload)
+{
+   if ((maxPayload < SLAY2_FRAME_PAYLOAD) || (maxPayload > SLAY2_MAX_FRAME_PAYLOAD) || (allocate(windowSize, maxPayload) == false))
+   {
+      return false;
+   }
+   if (framePayload > maxPayload)
+   {
+      framePayload = maxPayload;
+   }
+   reset();
+   return true;
+}
+
+
+//(re-)allocate the window. frames with a payload of more than SLAY2_FRAME_PAYLOAD bytes are encoded into buffers
+//of the pool. the previous window is kept, if the pool is exhausted
+bool Slay2TxScheduler::allocate(const unsigned int windowSize, const unsigned int maxPayload)
+{
+   if ((windowSize != this->windowSize) || (maxPayload != this->maxFramePayload))
+   {
+      const unsigned int bufferSize = SLAY2_TX_BUFFER_SIZE(maxPayload);
+      Slay2TxFrame * const fifo = (Slay2TxFrame *)pool->alloc(windowSize * sizeof(Slay2TxFrame));
+      unsigned char * const buffers = (maxPayload > SLAY2_FRAME_PAYLOAD) ? (unsigned char *)pool->alloc(windowSize * bufferSize) : NULL;
+      if ((fifo == NULL) || ((maxPayload > SLAY2_FRAME_PAYLOAD) && (buffers == NULL)))
+      {
+         pool->release(fifo);
+         pool->release(buffers);
+         return false;
+      }
+      dropWindow();
+      dataFifoCount = 0;
+      for (unsigned int i = 0; i < windowSize; ++i)
+      {
+         new (&fifo[i]) Slay2TxFrame(); //placement new: construct the frames within the block of the pool
+         if (buffers != NULL)
+         {
+            fifo[i].buffer.setBuffer(&buffers[i * bufferSize], bufferSize);
+         }
+      }
+      pool->release(dataFifo);
+      pool->release(frameBuffers);
+      dataFifo = fifo;
+      frameBuffers = buffers;
+      this->windowSize = windowSize;
+      this->maxFramePayload = maxPayload;
+   }
+   return true;
+}
+
+
+void Slay2TxScheduler::setFramePayload(const unsigned int payload)
+{
+   framePayload = (payload < SLAY2_FRAME_PAYLOAD) ? SLAY2_FRAME_PAYLOAD : ((payload > maxFramePayload) ? maxFramePayload : payload);
+}
+
+
+unsigned int Slay2TxScheduler::getFramePayload(void)
+{
+   return framePayload;
+}
+
+
+unsigned int Slay2TxScheduler::getWindowSize(void)
+{
+   return windowSize;
+}
+
+
+void Slay2TxScheduler::setSelectiveRepeat(const bool enable)
+{
+   selectiveRepeat = enable;
+}
+
+
+void Slay2TxScheduler::setBaudrate(const unsigned int baudrate)
+{
+   this->baudrate = (baudrate > 0) ? baudrate : SLAY2_DEFAULT_BAUDRATE;
+   rttValid = false;
+   backoff = 0;
+}
+
+
+unsigned int Slay2TxScheduler::getRto(void)
+{
+   return getTimeout(SLAY2_TX_BUFFER_SIZE(framePayload));
+}
+
+
+void Slay2TxScheduler::setSchedulingPolicy(const Slay2SchedulingPolicy policy)
+{
+   this->policy = policy;
+   drrChannel = 0;
+   drrQuantumAdded = false;
+}
+
+
+void Slay2TxScheduler::setAckDelay(const unsigned int delay1ms)
+{
+   cumAckDelay = delay1ms;
 }
 
 
 void Slay2TxScheduler::reset(void)
 {
+   dropWindow();
+   dataFifoHead = 0;
    dataFifoCount = 0;
+   ackFifoHead = 0;
    ackFifoCount = 0;
+   nakPending = false;
+   helloPending = false;
+   cumAckPending = false;
+   cumAckUrgent = false;
+   goBackNext = 0;
+   backoff = 0;
    nackCount = 0;
    txSeqNr = 0; //start with sequence number 0
 }
 
 
 //determine next frame according to their priority:
-// 1. ACK frames
-// 2. Retransmission of out-timed frames
+// 1. NAK and ACK frames
+// 2. Retransmission of negative acknowledged or out-timed frames
 // 3. New data frames
-Slay2Buffer * Slay2TxScheduler::getNextXfer(const unsigned int time1ms,
-                                            Slay2Channel * channels[], const unsigned int channelCount)
+Slay2Buffer * Slay2TxScheduler::getNextXfer(const unsigned int time1ms, Slay2Channel * channels[])
 {
+   //the HELLO frame follows the SYNC sequence. the remote endpoint sends large frames not until it got it
+   if (helloPending)
+   {
+      ackBuffer.flush();
+      ackBuffer.pushAck(SLAY2_ACK_TYPE_HELLO);
+      ackBuffer.pushAck((unsigned char)(helloPayload >> 8));
+      ackBuffer.pushAck((unsigned char)helloPayload);
+      ackBuffer.pushAckBig32(ackBuffer.getCrc32());
+      ackBuffer.pushEndOfAck();
+      helloPending = false;
+      return &ackBuffer;
+   }
+
+   //a NAK frame requests the retransmission of a missing frame. so it is even more urgent than an ACK
+   if (nakPending)
+   {
+      // cout << "->: NAK " << (unsigned int)nakSeqNr << endl;
+      ackBuffer.flush();
+      ackBuffer.pushAck(SLAY2_ACK_TYPE_NAK);
+      ackBuffer.pushAck(nakSeqNr);
+      ackBuffer.pushAckBig32(ackBuffer.getCrc32());
+      ackBuffer.pushEndOfAck();
+      nakPending = false;
+      return &ackBuffer;
+   }
+
    //any ack frame to be transmitted?
    if (ackFifoCount > 0)
    {
-      //get the oldest ack frame
-      Slay2Buffer * next = ackFifo[0];
-      // cout << "->: ACK "
-      //       << (unsigned int)Slay2AckDecodingBuffer::decodeAck(next->getBuffer(), 0)
-      //       << endl;
-      //"shuffle/pop" fifo
-      for (int i = 0; i < SLAY2_SCHEDULER_FIFO_DEPTH - 1; ++i)
-      {
-         ackFifo[i] = ackFifo[i+1];
-      }
+      //get the oldest ack and encode the ack frame
+      const unsigned char seqNr = ackFifo[ackFifoHead];
+      // cout << "->: ACK " << (unsigned int)seqNr << endl;
+      ackBuffer.flush();
+      ackBuffer.pushAck(seqNr);
+      ackBuffer.pushAckBig32(ackBuffer.getCrc32());
+      ackBuffer.pushEndOfAck();
+      //pop fifo
+      ackFifoHead = (ackFifoHead + 1) % SLAY2_SCHEDULER_ACK_DEPTH;
       --ackFifoCount;
-      return next;
+      return &ackBuffer;
+   }
+
+   //cumulative ack frame to be transmitted (after the coalescing delay)?
+   if (cumAckPending && (cumAckUrgent || ((time1ms - cumAckTime) >= cumAckDelay)))
+   {
+      // cout << "->: CUMULATIVE ACK " << (unsigned int)cumAckSeqNr << endl;
+      ackBuffer.flush();
+      ackBuffer.pushAck(SLAY2_ACK_TYPE_CUMULATIVE);
+      ackBuffer.pushAck(cumAckSeqNr);
+      ackBuffer.pushAck(cumAckBitmap, cumAckBitmapLen);
+      ackBuffer.pushAckBig32(ackBuffer.getCrc32());
+      ackBuffer.pushEndOfAck();
+      cumAckPending = false;
+      cumAckUrgent = false;
+      return &ackBuffer;
+   }
+
+   //go-back-N: after a timeout of the oldest frame, the receiver has dropped all subsequent frames of the window.
+   //retransmit them one after the other, without waiting for their own timeouts
+   if (goBackNext > 0)
+   {
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + goBackNext) % windowSize];
+      goBackNext = ((goBackNext + 1) < dataFifoCount) ? (goBackNext + 1) : 0;
+      // cout << "--> RTX: DATA " << (unsigned int)entry->seqNr << endl;
+      entry->txTime = time1ms;
+      entry->timeout = getTimeout(entry->buffer.getCount());
+      ++entry->txCount;
+      entry->sameLossEvent = true;
+      ++stats->retransmissions;
+      return &entry->buffer;
    }
 
-   //any pending data frames in fifo to be retransmitted because of timeout
-   if (dataFifoCount > 0)
+   //any pending data frames in fifo to be retransmitted because of a NAK or a timeout
+   //go-back-N: the oldest one, is expect to be acknowledged first. only this one is checked
+   //selective repeat: any frame of the window, that is not yet acknowledged, is checked
+   const unsigned int rtxCount = selectiveRepeat ? dataFifoCount : ((dataFifoCount > 0) ? 1 : 0);
+   for (unsigned int i = 0; i < rtxCount; ++i)
    {
-      //the oldest one, is expect to be acknowledged first
-      if ((time1ms - dataFifoTimeout[0][0]) > dataFifoTimeout[0][1]) //does (currentTime - transmissionTime) exceed the transmission timeout?
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + i) % windowSize];
+      if ((entry->acked == false) &&
+          (entry->nakked || //fast retransmission, requested by the receiver
+           ((time1ms - entry->txTime) > entry->timeout))) //does (currentTime - transmissionTime) exceed the transmission timeout?
       {
-         Slay2Buffer * next = dataFifo[0];
-         // cout << "--> RTX: DATA "
-         //      << (unsigned int)Slay2DataDecodingBuffer::decodeData(next->getBuffer(), 0)
-         //      << endl;
-         dataFifoTimeout[0][0] = time1ms; //store timestamp of new transmission
-         dataFifoTimeout[0][1] = SLAY2_TRANSMISSION_TIMEOUT; //set transmission timeout: transmission of 300 bytes (max length of a data frame) takes ~27ms at 115k, 8N1
-                                            //timeout is 27ms for transmission
-                                            //         + 27ms for to complete a ongoing transmission on the "reply channel"
-                                            //         +  6ms generous timeout for the reply of the ACK frame
+         // cout << "--> RTX: DATA " << (unsigned int)entry->seqNr << endl;
+         //exponential backoff: double the timeout on each loss event (but not on a NAK, the link is obviously alive).
+         //the timeouts of the other frames, that were transmitted before, belong to the same loss event (error burst, or go-back-N).
+         //until the 1st RTT sample, the timeout may just be too short. so it is doubled on every timeout
+         if ((entry->nakked == false) && ((entry->sameLossEvent == false) || (rttValid == false)) && (backoff < SLAY2_RTO_BACKOFF_MAX))
+         {
+            ++backoff;
+         }
+         entry->nakked = false;
+         for (unsigned int j = 0; j < dataFifoCount; ++j)
+         {
+            dataFifo[(dataFifoHead + j) % windowSize].sameLossEvent = true;
+         }
+         entry->sameLossEvent = false;
+         entry->txTime = time1ms; //store timestamp of new transmission
+         entry->timeout = getTimeout(entry->buffer.getCount());
+         ++entry->txCount;
+         if (selectiveRepeat == false)
+         {
+            goBackNext = (dataFifoCount > 1) ? 1 : 0;
+         }
          ++nackCount; //increment NACK counter
-         return next;
+         ++stats->retransmissions;
+         return &entry->buffer;
       }
    }
 
+   //try to allocate a fifo entry (transmission window exhausted?)
+   if (dataFifoCount >= windowSize)
+   {
+      // cout << "Slay2TxScheduler::getNextXfer overflow" << endl;
+      return NULL;
+   }
+
    //check if any channel has pending data to be transmitted
-   //the lower the channel number, the higher the transmission priority
-   for (unsigned int ch = 0; ch < channelCount; ++ch)
+   const int ch = selectChannel(channels);
+   if (ch >= 0)
    {
-      Slay2Channel * channel = channels[ch];
-      if (channel != NULL)
+      Slay2Channel * const channel = channels[ch];
+      const unsigned int count = channel->txFifo.getCount();
+      // cout << "->: DATA "
+      //      << (unsigned int)txSeqNr
+      //      << endl;
+
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + dataFifoCount) % windowSize];
+      Slay2DataEncodingBuffer * const data = &entry->buffer;
+      unsigned char header[2];
+      const unsigned char * seg[2];
+      unsigned int segLen[2];
+      entry->seqNr = txSeqNr;
+      entry->txCount = 1;
+      entry->nakked = false;
+      entry->sameLossEvent = false;
+      entry->acked = false;
+      entry->channel = channel;
+      header[0] = txSeqNr++; //set sequence number (wraps around from 255 to 0)
+      header[1] = (unsigned char)ch; //set channel number
+      //setup new data frame (no error expected here)
+      data->flush();
+      data->pushData(header, 2);
+      //compression (if enabled): as much input, as fits into the payload of a frame.
+      //if that does not pay off, fall back to a raw frame (except for the 1st frame after a reset of the dictionary)
+      unsigned int consumed = 0; //payload bytes taken from the fifo
+      unsigned int payload = 0;  //payload bytes of the frame
+      bool compressed = false;
+      if (channel->compressor != NULL)
       {
-         unsigned int count = channel->txFifo.getCount();
-         //check for transmit condition
-         if ((count >= SLAY2_FRAME_PAYLOAD) || //enough data to make one complete frame
-             ((count > 0) && (channel->txMore == false))) //at leaste one pending byte and no more data will follow
+         unsigned char packed[SLAY2_FRAME_PAYLOAD];
+         channel->txFifo.peek(seg, segLen, SLAY2_LZ_INPUT);
+         payload = channel->compressor->compress(seg, segLen, packed, sizeof(packed), &consumed);
+         compressed = (payload < consumed) || channel->compressor->isResetPending();
+         if (compressed)
          {
-            //try to allocate a fifo entry
-            if (dataFifoCount >= SLAY2_SCHEDULER_FIFO_DEPTH)
-            {
-               // cout << "Slay2TxScheduler::getNextXfer overflow" << endl;
-               return NULL;
-            }
+            channel->compressor->commit(consumed);
+            data->pushData(packed, payload);
+         }
+      }
+      if (compressed == false)
+      {
+         //set payload data
+         consumed = (count > framePayload) ? framePayload : count; //do limitation
+         if (channel->compressor != NULL)
+         {
+            //raw frames are part of the dictionary as well. the compressor holds the input of one compressed frame only
+            consumed = (consumed > SLAY2_LZ_INPUT) ? SLAY2_LZ_INPUT : consumed;
+            channel->compressor->commit(consumed);
+         }
+         payload = consumed;
+         //encode (and calculate crc of) the payload directly from the (up to two) contiguous segments of the fifo,
+         //without copying it before
+         channel->txFifo.peek(seg, segLen, consumed);
+         data->pushData(seg[0], segLen[0]);
+         data->pushData(seg[1], segLen[1]);
+      }
+      channel->txFifo.drop(consumed);
+      channel->txByteCount += consumed;
+      entry->consumed = consumed;
+      ++stats->txFrames;
+      stats->txBytes += consumed;
+      ++stats->channels[ch].txFrames;
+      stats->channels[ch].txBytes += consumed;
+      if (channel->deficit >= payload)
+      {
+         channel->deficit -= payload; //deficit round robin: charge the channel (by its share of the line)
+      }
+      updateReady(channel);
+      data->pushDataBig32(compressed ? (data->getCrc32() ^ SLAY2_CDATA_CRC_MASK) : data->getCrc32());
+      data->pushEndOfData(compressed);
 
-            // cout << "->: DATA "
-            //      << (unsigned int)txSeqNr
-            //      << endl;
-
-            Slay2DataEncodingBuffer * data = dataFifo[dataFifoCount];
-            //setup new data frame (no error expected here)
-            data->flush();
-            data->pushData(txSeqNr++); //set sequence number
-            data->pushData(ch); //set channel number
-            //set payload data
-            if (count > SLAY2_FRAME_PAYLOAD)
-            {
-               count = SLAY2_FRAME_PAYLOAD; //do limitation
-            }
-            for (unsigned int pay = 0; pay < count; ++pay)
+      entry->txTime = time1ms;
+      entry->firstTxTime = time1ms;
+      entry->timeout = getTimeout(data->getCount());
+      ++dataFifoCount;
+      return data;
+   }
+   // cout << "Slay2TxScheduler::getNextXfer NULL" << endl;
+   return NULL;
+}
+
+
+bool Slay2TxScheduler::acknowledgeXfer(const unsigned char seqNr, const unsigned int time1ms)
+{
+   //position of the acknowledged frame within the window (relative to the oldest one).
+   //as the window is less than half of the sequence number range, the 8-bit arithmetic is unambiguous, even across the wrap around
+   const unsigned char offset = (unsigned char)(seqNr - dataFifo[dataFifoHead].seqNr);
+   //go-back-N: the oldest one, is expect to be acknowledged first (receiver drops all frames out of order)
+   //selective repeat: any frame within the window may be acknowledged (receiver keeps frames out of order)
+   if ((offset < dataFifoCount) && ((offset == 0) || selectiveRepeat))
+   {
+      // cout << "<-: ACK "
+      //      << (unsigned int)seqNr
+      //      << endl << endl;
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + offset) % windowSize];
+      if (entry->acked == false)
+      {
+         updateRtt(entry, time1ms);
+         entry->acked = true;
+      }
+      release();
+      nackCount = 0;
+      return true;
+   }
+   // cout << "Slay2TxScheduler::acknowledgeXfer false, "
+   //      << (unsigned int)seqNr << " not expected" << endl;
+   return false;
+}
+
+
+//a cumulative acknowledge confirms all frames up to (and including) seqNr.
+//the optional bitmap confirms the frames (seqNr + 2 + bit), received out of order (selective repeat only)
+bool Slay2TxScheduler::acknowledgeCumulative(const unsigned char seqNr, const unsigned char * bitmap, const unsigned int bitmapLen,
+                                             const unsigned int time1ms)
+{
+   Slay2TxFrame * newest = NULL; //the newest frame, that is acknowledged by this ACK frame (for RTT estimation)
+   const unsigned char oldestSeqNr = dataFifo[dataFifoHead].seqNr;
+   const unsigned char last = (unsigned char)(seqNr - oldestSeqNr); //position of seqNr within the window
+   bool acked = false;
+
+   if (dataFifoCount == 0)
+   {
+      return false;
+   }
+   //all frames up to seqNr. if seqNr is "behind" the window, there is nothing new
+   if (last < dataFifoCount)
+   {
+      for (unsigned int i = 0; i <= last; ++i)
+      {
+         Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + i) % windowSize];
+         if (entry->acked == false)
+         {
+            entry->acked = true;
+            newest = entry;
+         }
+      }
+      acked = true;
+   }
+   //frames received out of order
+   if (selectiveRepeat)
+   {
+      for (unsigned int bit = 0; bit < (8 * bitmapLen); ++bit)
+      {
+         if (bitmap[bit / 8] & (1u << (bit % 8)))
+         {
+            const unsigned char offset = (unsigned char)(seqNr + 2 + bit - oldestSeqNr);
+            if (offset < dataFifoCount)
             {
-               unsigned char c = (unsigned char)channel->txFifo.pop();
-               data->pushData(c);
+               Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + offset) % windowSize];
+               if (entry->acked == false)
+               {
+                  entry->acked = true;
+                  newest = entry;
+               }
+               acked = true;
             }
-            data->pushDataBig32(data->getCrc32());
-            data->pushEndOfData();
-
-            //caluculate timeout.
-            //1. transmission speed, 115k2 bps, 8N1
-            //2. transmission time: 1ms per 10 bytes
-            //3. max length of a data frame is about 300bytes
-            //4. there may be up to 24 bytes in the tx fifo, at the time this transmission is scheduled -> ofset of ~3ms
-            //5. at the time the receiver receives this data frame, its tx fifo may contain ~325 output bytes (worst cast) -> offset of ~300ms
-            //6. transmission of an ack frame takes about 1ms
-            //7. receiver may need some time to preocess the input and answer with an ack -> offset 2ms
-            dataFifoTimeout[dataFifoCount][0] = time1ms;
-            dataFifoTimeout[dataFifoCount][1] = 3 + (count / 10) + 30 + 1 + 2; //rule4 + rule2 + rule5 + rule6 + rule7
-            ++dataFifoCount;
-            return data;
          }
       }
    }
-   // cout << "Slay2TxScheduler::getNextXfer NULL" << endl;
-   return NULL;
+   if (newest != NULL)
+   {
+      updateRtt(newest, time1ms);
+   }
+   if (acked)
+   {
+      release();
+      nackCount = 0;
+   }
+   return acked;
+}
+
+
+//a NAK frame requests the retransmission of the frame seqNr. as the receiver expects this frame next,
+//all frames before were received
+bool Slay2TxScheduler::retransmitXfer(const unsigned char seqNr, const unsigned int time1ms)
+{
+   if (dataFifoCount == 0)
+   {
+      return false;
+   }
+   const unsigned char offset = (unsigned char)(seqNr - dataFifo[dataFifoHead].seqNr);
+   if (offset >= dataFifoCount)
+   {
+      return false; //not (any more) within the window
+   }
+   if (offset > 0)
+   {
+      acknowledgeCumulative((unsigned char)(seqNr - 1), NULL, 0, time1ms);
+   }
+   //the requested frame is the oldest one now.
+   //ignore the NAK, if the frame was retransmitted less than a round trip ago (the retransmission is still on its way)
+   Slay2TxFrame * const entry = &dataFifo[dataFifoHead];
+   if ((entry->txCount > 1) &&
+       ((time1ms - entry->txTime) <= (getTransmissionTime(entry->buffer.getCount()) + (rttValid ? (unsigned int)(srtt8 >> 3) : 0))))
+   {
+      return false;
+   }
+   entry->nakked = true;
+   return true;
+}
+
+
+//time [ms], until getNextXfer() has to be called again (unless new data is sent or received).
+//0: a frame is ready for transmission. SLAY2_NO_DEADLINE: nothing to be done
+unsigned int Slay2TxScheduler::getIdleTime(const unsigned int time1ms)
+{
+   //HELLO, NAK and ACK frames, and the retransmissions of go-back-N are transmitted without delay
+   if (helloPending || nakPending || (ackFifoCount > 0) || (cumAckPending && cumAckUrgent) || (goBackNext > 0))
+   {
+      return 0;
+   }
+   unsigned int idle = SLAY2_NO_DEADLINE;
+   //coalescing delay of the cumulative ack frame
+   if (cumAckPending)
+   {
+      const unsigned int elapsed = time1ms - cumAckTime;
+      idle = (elapsed >= cumAckDelay) ? 0 : (cumAckDelay - elapsed);
+   }
+   //retransmission timeouts (the same frames as checked by getNextXfer)
+   const unsigned int rtxCount = selectiveRepeat ? dataFifoCount : ((dataFifoCount > 0) ? 1 : 0);
+   for (unsigned int i = 0; i < rtxCount; ++i)
+   {
+      const Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + i) % windowSize];
+      if (entry->acked == false)
+      {
+         const unsigned int elapsed = time1ms - entry->txTime;
+         const unsigned int remaining = (entry->nakked || (elapsed > entry->timeout)) ? 0 : (entry->timeout - elapsed + 1);
+         if (remaining < idle)
+         {
+            idle = remaining;
+         }
+      }
+   }
+   //new data frames
+   if ((dataFifoCount < windowSize) && (ready.isEmpty() == false))
+   {
+      return 0;
+   }
+   return idle;
+}
+
+
+//select the channel of the next data frame. returns -1, if no channel is ready
+int Slay2TxScheduler::selectChannel(Slay2Channel * channels[])
+{
+   if (policy == SLAY2_STRICT_PRIORITY)
+   {
+      //the lower the channel number, the higher the transmission priority
+      return ready.findNext(0);
+   }
+
+   //deficit round robin: on its turn, a ready channel gets a quantum (according to its weight) added to its deficit.
+   //it is served, as long as the deficit covers its next frame. then it's the turn of the next ready channel.
+   //as a quantum covers at least one frame with max. payload, this one can be served in any case
+   if (ready.isEmpty())
+   {
+      return -1;
+   }
+   if (ready.contains(drrChannel))
+   {
+      Slay2Channel * const channel = channels[drrChannel];
+      if (drrQuantumAdded == false)
+      {
+         channel->deficit += channel->weight * getQuantum();
+         drrQuantumAdded = true;
+      }
+      const unsigned int count = channel->txFifo.getCount();
+      if (((count < framePayload) ? count : framePayload) <= channel->deficit)
+      {
+         return (int)drrChannel;
+      }
+   }
+   drrChannel = (unsigned int)nextReady(drrChannel);
+   channels[drrChannel]->deficit += channels[drrChannel]->weight * getQuantum();
+   drrQuantumAdded = true;
+   return (int)drrChannel;
+}
+
+
+//next ready channel after the given one (wraps around). this may be the given channel itself
+int Slay2TxScheduler::nextReady(const unsigned int channel)
+{
+   const int next = ready.findNext(channel + 1);
+   return (next >= 0) ? next : ready.findNext(0);
+}
+
+
+//update the set of ready channels
+void Slay2TxScheduler::updateReady(Slay2Channel * const channel)
+{
+   if (isTxReady(channel))
+   {
+      ready.insert(channel->channel);
+   }
+   else
+   {
+      ready.remove(channel->channel);
+      channel->deficit = 0; //deficit round robin: an idle channel must not save up its quantum
+   }
+}
+
+
+//check for transmit condition of a channel
+bool Slay2TxScheduler::isTxReady(Slay2Channel * const channel)
+{
+   if (channel == NULL)
+   {
+      return false;
+   }
+   const unsigned int count = channel->txFifo.getCount();
+   return (count >= framePayload) || //enough data to make one complete frame
+          ((count > 0) && (channel->txFifo.getSpace() == 0)) || //TX buffer is full (smaller than a frame)
+          ((count > 0) && (channel->txMore == false)); //at leaste one pending byte and no more data will follow
 }
 
 
-bool Slay2TxScheduler::acknowledgeXfer(const unsigned char seqNr)
+//release all acknowledged frames from the beginning of the window
+void Slay2TxScheduler::release(void)
 {
-   if (dataFifoCount != 0) //are there pending data frames in the fifo, waiting for acknowlede?
+   while ((dataFifoCount > 0) && dataFifo[dataFifoHead].acked)
    {
-      Slay2DataEncodingBuffer * data = dataFifo[0]; //the oldest one, is expect to be acknowledged first
-      unsigned char actSeqNr = Slay2DataDecodingBuffer::decodeData(data->getBuffer(), 0); //first data byte is expected to be the sequence number
-      //does actual and expected sequence number match?
-      if (actSeqNr == seqNr)
+      //the frames of a channel are released in order: all its bytes up to this offset are acknowledged
+      if (dataFifo[dataFifoHead].channel != NULL)
       {
-         // cout << "<-: ACK "
-         //      << (unsigned int)seqNr
-         //      << endl << endl;
+         dataFifo[dataFifoHead].channel->txAckedOffset += dataFifo[dataFifoHead].consumed;
+      }
+      dataFifo[dataFifoHead].buffer.flush();
+      dataFifoHead = (dataFifoHead + 1) % windowSize;
+      --dataFifoCount;
+      if (goBackNext > 0)
+      {
+         --goBackNext; //the frames to be retransmitted move towards the beginning of the window
+      }
+   }
+}
+
 
-         //yes -> flush buffer and "rotate/pop" fifo
-         data->flush();
-         for (int i = 0; i < SLAY2_SCHEDULER_FIFO_DEPTH - 1; ++i)
+void Slay2TxScheduler::dropWindow(void)
+{
+   for (unsigned int i = 0; i < dataFifoCount; ++i)
+   {
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + i) % windowSize];
+      if (entry->channel != NULL)
+      {
+         entry->channel->txAckedOffset += entry->consumed; //lost frames are skipped by the acknowledged offset
+         if (entry->acked == false)
          {
-            dataFifo[i] = dataFifo[i+1];
-            dataFifoTimeout[i][0] = dataFifoTimeout[i+1][0];
-            dataFifoTimeout[i][1] = dataFifoTimeout[i+1][1];
+            entry->channel->txDroppedByteCount += entry->consumed;
          }
-         dataFifo[SLAY2_SCHEDULER_FIFO_DEPTH - 1] = data;
-         dataFifoTimeout[SLAY2_SCHEDULER_FIFO_DEPTH - 1][0] = 0;
-         dataFifoTimeout[SLAY2_SCHEDULER_FIFO_DEPTH - 1][1] = 0;
-         --dataFifoCount;
-         nackCount = 0;
-         return true;
-      }
-      // else
-      // {
-      //    cout << "Slay2TxScheduler::acknowledgeXfer false, "
-      //         << (unsigned int)actSeqNr << " != " << (unsigned int)seqNr << endl;
-      //    return false;
-      // }
-   }
-   // cout << "Slay2TxScheduler::acknowledgeXfer false" << endl;
-   return false;
+      }
+   }
+}
+
+
+void Slay2TxScheduler::detachChannel(Slay2Channel * const channel)
+{
+   for (unsigned int i = 0; i < dataFifoCount; ++i)
+   {
+      Slay2TxFrame * const entry = &dataFifo[(dataFifoHead + i) % windowSize];
+      if (entry->channel == channel)
+      {
+         entry->channel = NULL;
+      }
+   }
+}
+
+
+//transmission time [ms] of "bytes" bytes (8N1: 10 bits per byte), rounded up
+unsigned int Slay2TxScheduler::getTransmissionTime(const unsigned int bytes)
+{
+   return ((bytes * 10u * 1000u) + baudrate - 1) / baudrate;
+}
+
+
+//deficit round robin: bytes per round and weight unit. it covers at least one frame with max. payload
+unsigned int Slay2TxScheduler::getQuantum(void)
+{
+   return (framePayload > SLAY2_DRR_QUANTUM) ? framePayload : SLAY2_DRR_QUANTUM;
+}
+
+
+//number of bytes in the TX buffer of the driver, below which the next frame is passed to it. derived from the baudrate,
+//but at least SLAY2_TX_THRESHOLD (so ACK frames don't wait behind a data frame)
+unsigned int Slay2TxScheduler::getTxThreshold(void)
+{
+   const unsigned int bytes = ((baudrate / 10u) * SLAY2_TX_LEAD_TIME) / 1000u; //8N1: 10 bits per byte
+   return (bytes > SLAY2_TX_THRESHOLD) ? bytes : SLAY2_TX_THRESHOLD;
+}
+
+
+//retransmission timeout [ms] of a data frame of "bytes" (encoded) bytes:
+//transmission time of the frame itself + response time of the remote endpoint (ACK frame), doubled by each backoff
+unsigned int Slay2TxScheduler::getTimeout(const unsigned int bytes)
+{
+   unsigned int response;
+   if (rttValid)
+   {
+      //Jacobson/Karels: SRTT + 4 * RTTVAR (at least the timer granularity)
+      response = (unsigned int)(srtt8 >> 3) + (unsigned int)((rttvar4 > 1) ? rttvar4 : 1);
+   }
+   else
+   {
+      //no estimation yet. the round trip time of the link is unknown, so start conservatively (RFC 6298),
+      //but at least the worst case of the line itself:
+      //up to "threshold" bytes in the tx fifo at the time the frame is scheduled
+      // + receiver has to complete the transmission of a data frame with max. length, before it can send the ACK frame
+      // + transmission of the ACK frame
+      response = getTransmissionTime(getTxThreshold() + SLAY2_TX_BUFFER_SIZE(framePayload) + SLAY2_ACK_BUFFER);
+      if (response < SLAY2_RTO_INITIAL)
+      {
+         response = SLAY2_RTO_INITIAL;
+      }
+   }
+   if (response < SLAY2_RTO_MIN)
+   {
+      response = SLAY2_RTO_MIN;
+   }
+   const unsigned int timeout = getTransmissionTime(bytes) + response;
+   //exponential backoff, limited by SLAY2_RTO_MAX (but never below the timeout without backoff)
+   const unsigned int backedOff = getTransmissionTime(bytes) + (response << backoff);
+   if (backedOff > SLAY2_RTO_MAX)
+   {
+      return (timeout > SLAY2_RTO_MAX) ? timeout : SLAY2_RTO_MAX;
+   }
+   return backedOff;
+}
+
+
+//update the estimation of the response time by the round trip time of an acknowledged frame
+void Slay2TxScheduler::updateRtt(Slay2TxFrame * const frame, const unsigned int time1ms)
+{
+   const unsigned int txTime = getTransmissionTime(frame->buffer.getCount());
+   unsigned int rtt = time1ms - frame->txTime;
+   if (frame->txCount > 1)
+   {
+      //Karn's rule: the acknowledge of a retransmitted frame may belong to any of its transmissions -> no sample.
+      //but an acknowledge, that arrives before the retransmission is even transmitted completely, belongs to the first
+      //transmission (the timeout was too short). without that sample, a too short timeout would never be corrected
+      if ((frame->txCount > 2) || (rtt >= txTime))
+      {
+         if (rttValid && (backoff > 0))
+         {
+            --backoff; //the link is alive. unwind the backoff step by step (but keep it until the 1st sample)
+         }
+         return;
+      }
+      rtt = time1ms - frame->firstTxTime;
+   }
+   ++stats->rttCount;
+   stats->rttSum += rtt;
+   if ((stats->rttMin > rtt) || (stats->rttCount == 1))
+   {
+      stats->rttMin = rtt;
+   }
+   if (stats->rttMax < rtt)
+   {
+      stats->rttMax = rtt;
+   }
+   //the response time is the round trip time without the transmission time of the frame itself. so the estimation
+   //applies to frames of any length
+   const int sample = (rtt > txTime) ? (int)(rtt - txTime) : 0;
+   if (rttValid == false)
+   {
+      srtt8 = sample << 3;   //SRTT = R
+      rttvar4 = sample << 1; //RTTVAR = R / 2
+      rttValid = true;
+   }
+   else
+   {
+      int err = sample - (srtt8 >> 3);
+      srtt8 += err;                     //SRTT += (R - SRTT) / 8
+      if (err < 0)
+      {
+         err = -err;
+      }
+      rttvar4 += err - (rttvar4 >> 2);  //RTTVAR += (|R - SRTT| - RTTVAR) / 4
+   }
+   backoff = 0; //a valid sample ends the backoff
 }
 
 
 bool Slay2TxScheduler::scheduleAck(const unsigned char seqNr)
 {
-   if (ackFifoCount < SLAY2_SCHEDULER_FIFO_DEPTH)
+   if (ackFifoCount < SLAY2_SCHEDULER_ACK_DEPTH)
    {
-      Slay2AckEncodingBuffer * ack = ackFifo[ackFifoCount];
-      //setup new acknowledge
-      ack->flush();
-      ack->pushAck(seqNr);
-      ack->pushAckBig32(ack->getCrc32());
-      ack->pushEndOfAck();
+      //just remember the sequence number. the ack frame is encoded, at the time it is going to be transmitted
+      ackFifo[(ackFifoHead + ackFifoCount) % SLAY2_SCHEDULER_ACK_DEPTH] = seqNr;
       ++ackFifoCount;
       return true;
    }
@@ -216,7 +814,111 @@ bool Slay2TxScheduler::scheduleAck(const unsigned char seqNr)
 }
 
 
+//request the retransmission of a missing frame. a NAK frame is transmitted immediately
+void Slay2TxScheduler::scheduleNak(const unsigned char seqNr)
+{
+   nakPending = true;
+   nakSeqNr = seqNr;
+}
+
+
+void Slay2TxScheduler::scheduleHello(const unsigned int maxPayload)
+{
+   helloPending = true;
+   helloPayload = maxPayload;
+}
+
+
+//update the (single) pending cumulative acknowledge. it supersedes the previous one.
+//it is transmitted after the coalescing delay, or immediately if urgent
+void Slay2TxScheduler::scheduleCumulativeAck(const unsigned char seqNr, const unsigned char * bitmap, const unsigned int bitmapLen,
+                                             const unsigned int time1ms, const bool urgent)
+{
+   if (cumAckPending == false)
+   {
+      cumAckPending = true;
+      cumAckTime = time1ms;
+   }
+   cumAckUrgent |= urgent;
+   cumAckSeqNr = seqNr;
+   cumAckBitmapLen = (bitmapLen < SLAY2_ACK_BITMAP) ? bitmapLen : SLAY2_ACK_BITMAP;
+   memcpy(cumAckBitmap, bitmap, cumAckBitmapLen);
+}
+
+
 unsigned int Slay2TxScheduler::getNackCount(void)
 {
    return nackCount;
 }
+
+
+
+void Slay2ChannelSet::clear(void)
+{
+   memset(words, 0, sizeof(words));
+}
+
+void Slay2ChannelSet::insert(const unsigned int channel)
+{
+   words[channel / 64] |= (1ull << (channel % 64));
+}
+
+void Slay2ChannelSet::remove(const unsigned int channel)
+{
+   words[channel / 64] &= ~(1ull << (channel % 64));
+}
+
+bool Slay2ChannelSet::contains(const unsigned int channel) const
+{
+   return (channel < SLAY2_MAX_CHANNELS) && ((words[channel / 64] & (1ull << (channel % 64))) != 0);
+}
+
+bool Slay2ChannelSet::isEmpty(void) const
+{
+   for (unsigned int i = 0; i < SLAY2_CHANNEL_SET_WORDS; ++i)
+   {
+      if (words[i] != 0)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+int Slay2ChannelSet::findNext(const unsigned int channel) const
+{
+   if (channel >= SLAY2_MAX_CHANNELS)
+   {
+      return -1;
+   }
+   //mask the members below the given channel, within its word
+   unsigned int i = channel / 64;
+   unsigned long long word = words[i] & (~0ull << (channel % 64));
+   while (word == 0)
+   {
+      if (++i >= SLAY2_CHANNEL_SET_WORDS)
+      {
+         return -1;
+      }
+      word = words[i];
+   }
+   return (int)((i * 64) + countTrailingZeros(word));
+}
+
+//index of the lowest set bit. word must not be 0
+unsigned int Slay2ChannelSet::countTrailingZeros(const unsigned long long word)
+{
+#if defined (__GNUC__)
+   return (unsigned int)__builtin_ctzll(word);
+#else
+   //de Bruijn multiplication of the isolated lowest bit
+   static const unsigned char table[64] =
+   {
+       0,  1,  2, 53,  3,  7, 54, 27,  4, 38, 41,  8, 34, 55, 48, 28,
+      62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+      63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+      51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12
+   };
+   return table[((word & (0ull - word)) * 0x022FDD63CC95386Dull) >> 58];
+#endif
+}
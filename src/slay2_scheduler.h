@@ -12,31 +12,170 @@
 #include "slay2_buffer.h"
 
 /* -- Defines ------------------------------------------------------------- */
-#define SLAY2_SCHEDULER_FIFO_DEPTH     (3) //shall not be less than 3
+#define SLAY2_SCHEDULER_FIFO_DEPTH     (3)   //default window size (number of unacknowledged data frames)
+#define SLAY2_SCHEDULER_MAX_WINDOW     (127) //max. window size. must be less than half of the 8-bit sequence number range
+#define SLAY2_SCHEDULER_ACK_DEPTH      (SLAY2_SCHEDULER_MAX_WINDOW + 1) //number of pending acknowledges (enough for the max. window of the remote endpoint)
+
+#ifndef SLAY2_DEFAULT_BAUDRATE
+ #define SLAY2_DEFAULT_BAUDRATE        (115200) //assumed baudrate (8N1) of the serial line, unless set by setBaudrate()
+#endif
+#ifndef SLAY2_RTO_MIN
+ #define SLAY2_RTO_MIN                 (2)   //min. response time [ms] of the remote endpoint (timer granularity and processing of the ACK)
+#endif
+#ifndef SLAY2_RTO_INITIAL
+ #define SLAY2_RTO_INITIAL             (1000) //response time [ms] of the remote endpoint, assumed until the 1st RTT sample (RFC 6298)
+#endif
+#ifndef SLAY2_RTO_MAX
+ #define SLAY2_RTO_MAX                 (10000) //upper limit [ms] of the exponential backoff of the retransmission timeout
+#endif
+#define SLAY2_RTO_BACKOFF_MAX          (6)   //the retransmission timeout is doubled at most 6 times
+
+#define SLAY2_TX_THRESHOLD             (24)  //another frame is passed to the driver, if there are less/equal than 24 bytes in its TX buffer (24 ^= 3 ACK frames)...
+#ifndef SLAY2_TX_LEAD_TIME
+ #define SLAY2_TX_LEAD_TIME            (2)   //... or less than the line transmits within 2 ms (at high baudrates). so the line keeps busy until the next task() call
+#endif
+
+#define SLAY2_NO_DEADLINE              (0xFFFFFFFFu) //idle time, if there is nothing to be done until new data is sent or received
+
+#ifndef SLAY2_ACK_DELAY
+ #define SLAY2_ACK_DELAY               (2)   //default delay [ms] to coalesce acknowledges into a single cumulative ACK frame
+#endif
+
+#ifndef SLAY2_DRR_QUANTUM
+ #define SLAY2_DRR_QUANTUM             (SLAY2_FRAME_PAYLOAD) //bytes per round and weight unit (at least one frame with max. payload)
+#endif
+
+#define SLAY2_MAX_CHANNELS             (256) //the channel number is a single byte on the wire
+#define SLAY2_CHANNEL_SET_WORDS        (SLAY2_MAX_CHANNELS / 64)
 
 /* -- Types --------------------------------------------------------------- */
 class Slay2Channel; //forward declaration
+struct Slay2Stats; //forward declaration
+
+
+//policy to select the channel of the next data frame
+enum Slay2SchedulingPolicy
+{
+   SLAY2_STRICT_PRIORITY, //the lower the channel number, the higher the priority (default)
+   SLAY2_DEFICIT_ROUND_ROBIN //ready channels share the line according to their weights
+};
+
+
+//set of channel numbers (0..255), e.g. the channels, that are ready for transmission.
+//the next member is found by count-trailing-zeros, independent of the number of channels
+class Slay2ChannelSet
+{
+public:
+   Slay2ChannelSet() { clear(); }
+   void clear(void);
+   void insert(const unsigned int channel);
+   void remove(const unsigned int channel);
+   bool contains(const unsigned int channel) const;
+   bool isEmpty(void) const;
+   int findNext(const unsigned int channel) const; //lowest member >= channel. returns -1, if there is none
+
+private:
+   static unsigned int countTrailingZeros(const unsigned long long word);
+   unsigned long long words[SLAY2_CHANNEL_SET_WORDS];
+};
+
+
+//a data frame within the transmission window
+struct Slay2TxFrame
+{
+   Slay2DataEncodingBuffer buffer; //encoded frame
+   unsigned int txTime;  //time of (the last) transmission
+   unsigned int firstTxTime; //time of the first transmission
+   unsigned int timeout; //transmission timeout
+   unsigned int txCount; //number of transmissions. the acknowledge of a retransmitted frame is ambiguous (Karn's rule)
+   unsigned char seqNr;  //sequence number of the frame
+   Slay2Channel * channel; //owner of the payload (NULL: closed meanwhile)
+   unsigned int consumed; //payload bytes taken from the TX buffer of the channel (uncompressed)
+   bool sameLossEvent;   //frame was transmitted before the last timeout. its own timeout does not increase the backoff
+   bool nakked;          //retransmission requested by the receiver (NAK frame)
+   bool acked;           //acknowledged (out of order), but not yet released from the window (selective repeat)
+};
 
 
 class Slay2TxScheduler
 {
 public:
-   Slay2TxScheduler();
+   Slay2TxScheduler(Slay2Pool * const pool, Slay2Stats * const stats, const unsigned int windowSize = SLAY2_SCHEDULER_FIFO_DEPTH);
+   ~Slay2TxScheduler();
+   bool setWindowSize(const unsigned int windowSize); //this implies a reset
+   unsigned int getWindowSize(void);
+   bool setMaxFramePayload(const unsigned int maxPayload); //capacity of the frames of the window. this implies a reset
+   void setFramePayload(const unsigned int payload); //max. payload of new data frames (negotiated with the remote endpoint)
+   unsigned int getFramePayload(void);
+   void setSelectiveRepeat(const bool enable); //accept acknowledges of any frame in the window (not only of the oldest one)
+   void setBaudrate(const unsigned int baudrate); //this restarts the RTT estimation
+   void setSchedulingPolicy(const Slay2SchedulingPolicy policy);
+   unsigned int getRto(void); //current retransmission timeout [ms] of a data frame with max. length
    void reset(void);
-   Slay2Buffer * getNextXfer(const unsigned int time1ms,
-                             Slay2Channel * channels[], const unsigned int channelCount);
-   bool acknowledgeXfer(const unsigned char seqNr);
+   Slay2Buffer * getNextXfer(const unsigned int time1ms, Slay2Channel * channels[]);
+   bool acknowledgeXfer(const unsigned char seqNr, const unsigned int time1ms);
+   bool acknowledgeCumulative(const unsigned char seqNr, const unsigned char * bitmap, const unsigned int bitmapLen,
+                              const unsigned int time1ms);
+   bool retransmitXfer(const unsigned char seqNr, const unsigned int time1ms); //NAK received
    bool scheduleAck(const unsigned char seqNr);
+   void scheduleNak(const unsigned char seqNr);
+   void scheduleHello(const unsigned int maxPayload); //announce the max. payload of frames, I'm able to receive
+   void scheduleCumulativeAck(const unsigned char seqNr, const unsigned char * bitmap, const unsigned int bitmapLen,
+                              const unsigned int time1ms, const bool urgent);
+   void setAckDelay(const unsigned int delay1ms);
+   unsigned int getIdleTime(const unsigned int time1ms);
+   void updateReady(Slay2Channel * const channel); //to be called, whenever the TX fifo or the "more" flag of a channel changed
+   void detachChannel(Slay2Channel * const channel); //the channel is closed: it is no longer the owner of frames in the window
+   unsigned int getTransmissionTime(const unsigned int bytes);
+   unsigned int getTxThreshold(void); //a frame is passed to the driver, if its TX buffer contains less/equal bytes
    unsigned int getNackCount(void);
 
 private:
-   Slay2DataEncodingBuffer _dataBuffer[SLAY2_SCHEDULER_FIFO_DEPTH];
-   Slay2DataEncodingBuffer * dataFifo[SLAY2_SCHEDULER_FIFO_DEPTH];
-   unsigned int dataFifoTimeout[SLAY2_SCHEDULER_FIFO_DEPTH][2];
+   bool allocate(const unsigned int windowSize, const unsigned int maxPayload);
+   void release(void);
+   void dropWindow(void); //the frames of the window get lost (reset, reallocation)
+   bool isTxReady(Slay2Channel * const channel);
+   int selectChannel(Slay2Channel * channels[]);
+   int nextReady(const unsigned int channel);
+   unsigned int getTimeout(const unsigned int bytes);
+   unsigned int getQuantum(void);
+   void updateRtt(Slay2TxFrame * const frame, const unsigned int time1ms);
+
+   Slay2Pool * pool;
+   Slay2Stats * stats;
+   Slay2TxFrame * dataFifo; //ring buffer of "windowSize" data frames, waiting for acknowledge
+   unsigned char * frameBuffers; //encoded large frames of the window (NULL: the frames use their own buffers)
+   unsigned int maxFramePayload; //capacity of the frames of the window
+   unsigned int framePayload; //max. payload of new data frames
+   unsigned int dataFifoHead; //index of the oldest entry
    unsigned int dataFifoCount; //number of valid entries in the fifo
-   Slay2AckEncodingBuffer _ackBuffer[SLAY2_SCHEDULER_FIFO_DEPTH];
-   Slay2AckEncodingBuffer * ackFifo[SLAY2_SCHEDULER_FIFO_DEPTH];
+   unsigned int windowSize;
+   bool selectiveRepeat;
+   Slay2AckEncodingBuffer ackBuffer; //the ack frame, that is currently being transmitted
+   unsigned char ackFifo[SLAY2_SCHEDULER_ACK_DEPTH]; //ring buffer of sequence numbers to be acknowledged
+   unsigned int ackFifoHead; //index of the oldest entry
    unsigned int ackFifoCount; //number of valid entries in the fifo
+   bool nakPending; //a NAK frame is waiting for transmission
+   unsigned char nakSeqNr; //sequence number of the missing frame
+   bool helloPending; //a HELLO frame is waiting for transmission
+   unsigned int helloPayload; //... announcing this max. payload
+   bool cumAckPending; //a cumulative ACK frame is waiting for transmission
+   bool cumAckUrgent; //... without delay
+   unsigned int cumAckTime; //time, the cumulative ACK became pending
+   unsigned int cumAckDelay; //delay to coalesce acknowledges
+   unsigned char cumAckSeqNr; //all frames up to this sequence number were received
+   unsigned char cumAckBitmap[SLAY2_ACK_BITMAP]; //frames received beyond (cumAckSeqNr + 2 + bit)
+   unsigned int cumAckBitmapLen;
+   Slay2ChannelSet ready; //channels, that are ready for transmission
+   Slay2SchedulingPolicy policy;
+   unsigned int drrChannel; //deficit round robin: channel, whose turn it is
+   bool drrQuantumAdded;    //... and that already got its quantum in this round
+   unsigned int goBackNext; //go-back-N: position of the next frame to be retransmitted after a timeout (0: none)
+   unsigned int baudrate;
+   bool rttValid; //at least one RTT sample was taken
+   int srtt8;     //smoothed response time [ms], scaled by 8
+   int rttvar4;   //mean deviation of the response time [ms], scaled by 4
+   unsigned int backoff; //number of doublings of the retransmission timeout
    unsigned int nackCount; //no/negative acknowledge counter
    unsigned char txSeqNr;
 };
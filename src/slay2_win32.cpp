@@ -30,11 +30,17 @@ Slay2Win32::Slay2Win32()
 {
    fileHandle = INVALID_HANDLE_VALUE;
    InitializeCriticalSection(&critical); //init critical section for thread synchronization
+   criticalDepth = 0;
+   //blocking reads wait on their own critical section. a condition variable can't release one, that is owned more than once
+   InitializeCriticalSection(&rxCritical);
+   InitializeConditionVariable(&rxCond);
+   rxEvents = 0;
 }
 
 Slay2Win32::~Slay2Win32()
 {
    shutdown();
+   DeleteCriticalSection(&rxCritical);
    DeleteCriticalSection(&critical);
 }
 
@@ -90,6 +96,7 @@ bool Slay2Win32::init(const char * serPortName, const unsigned int baudrate)
          // the number of characters that have already been received, even if no characters have been received.
       timeouts.ReadIntervalTimeout = MAXDWORD;
       SetCommTimeouts(fileHandle, &timeouts);
+      setBaudrate(baudrate); //scale the retransmission timeout
       return true; //success
    }
 
@@ -114,17 +121,64 @@ unsigned int Slay2Win32::getTime1ms(void)
 }
 
 
+//performance counter in microseconds (wraps around). used for the statistics
+unsigned int Slay2Win32::getTime1us(void)
+{
+   LARGE_INTEGER frequency;
+   LARGE_INTEGER now;
+   QueryPerformanceFrequency(&frequency);
+   QueryPerformanceCounter(&now);
+   return (unsigned int)((now.QuadPart / frequency.QuadPart) * 1000000 + ((now.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+}
+
+
 void Slay2Win32::enterCritical(void)
 {
    EnterCriticalSection(&critical);
+   ++criticalDepth;
 }
 
 void Slay2Win32::leaveCritical(void)
 {
+   --criticalDepth;
    LeaveCriticalSection(&critical);
 }
 
 
+//the caller owns the critical section once. it is released while waiting for notifyReceived()
+bool Slay2Win32::waitReceived(const unsigned int timeout1ms)
+{
+   if (criticalDepth != 1)
+   {
+      return false; //the critical section would still be owned (e.g. within a receiver) -> task() could not wake me up
+   }
+   //the rxCritical is entered, before the critical section is left: notifyReceived() can't get lost meanwhile
+   EnterCriticalSection(&rxCritical);
+   const unsigned int events = rxEvents;
+   leaveCritical();
+   const DWORD start1ms = GetTickCount();
+   DWORD elapsed1ms = 0;
+   while ((rxEvents == events) && (elapsed1ms < timeout1ms))
+   {
+      SleepConditionVariableCS(&rxCond, &rxCritical, timeout1ms - elapsed1ms);
+      elapsed1ms = GetTickCount() - start1ms;
+   }
+   const bool notified = (rxEvents != events);
+   LeaveCriticalSection(&rxCritical);
+   enterCritical();
+   return notified;
+}
+
+
+void Slay2Win32::notifyReceived(void)
+{
+   EnterCriticalSection(&rxCritical);
+   ++rxEvents;
+   WakeAllConditionVariable(&rxCond);
+   LeaveCriticalSection(&rxCritical);
+}
+
+
 unsigned int Slay2Win32::getTxCount(void)
 {
    if (fileHandle != INVALID_HANDLE_VALUE)
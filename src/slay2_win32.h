@@ -21,13 +21,19 @@ class Slay2Win32 : public Slay2
 public:
    Slay2Win32();
    ~Slay2Win32();
-   bool init(const char * serPortName, const unsigned int baudrate); //for baudrates slower than 115k2 the "SLAY2_TRANSMISSION_TIMEOUT" value must probably be adjusted (via global preprocessor define!!!)
+   bool init(const char * serPortName, const unsigned int baudrate); //the retransmission timeout is adapted to the baudrate
    void shutdown(void);
 
    unsigned int getTime1ms(void);
+   unsigned int getTime1us(void);
 
    void enterCritical(void);
    void leaveCritical(void);
+   //blocking read of RX rings and flushAndWait(). there is no I/O thread: they run task() themselves (see
+   //Slay2::hasTaskThread), and pause in between. within a receiver (the critical section is owned more than once), they
+   //return at once (like a non-blocking read)
+   bool waitReceived(const unsigned int timeout1ms);
+   void notifyReceived(void);
 
 protected: //normally protected. for testing purpose, these functions may be made public
    unsigned int getTxCount(void);
@@ -40,6 +46,10 @@ private:
 
    void * fileHandle;
    CRITICAL_SECTION critical;
+   unsigned int criticalDepth; //number of nested enterCritical() of the owner of the critical section
+   CRITICAL_SECTION rxCritical; //entered once only. guards rxEvents
+   CONDITION_VARIABLE rxCond; //signals data put into an RX ring, or received acknowledges (uses the rxCritical)
+   unsigned int rxEvents; //counts the calls of notifyReceived()
 };
 
 
@@ -1,12 +1,13 @@
 #include <iostream>
 #include <cstdlib>
+#include <unistd.h>
 #include "slay2.h"
 #include "slay2_nullmodem.h"
 
 using namespace std;
 
 #define APP_CH_CNT   (8)
-#define APP_TEST_CNT (1)
+#define APP_TEST_CNT (1) //default number of transfers (see option -n)
 
 
 
@@ -46,8 +47,38 @@ static void on_serial_receive(void * const obj, const unsigned char * const data
 }
 
 
+static void usage(const char * const name)
+{
+   cout << "usage: " << name << " [-b baudrate] [-d delay_ms] [-e bit_error_rate] [-l burst_length] [-x drop_rate] "
+        << "[-u duplicate_rate] [-s seed] [-n transfers]" << endl;
+}
+
+
 int main(int argc, char * argv[])
 {
+   //impairments of the line (default: ideal line)
+   Slay2Impairment impairment;
+   memset(&impairment, 0, sizeof(impairment));
+   bool impaired = false;
+   int testCnt = APP_TEST_CNT;
+   int opt;
+   while ((opt = getopt(argc, argv, "b:d:e:l:x:u:s:n:h")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b': impairment.baudrate = atoi(optarg); break;
+         case 'd': impairment.delay1ms = atoi(optarg); break;
+         case 'e': impairment.bitErrorRate = atof(optarg); break;
+         case 'l': impairment.burstLength = atoi(optarg); break;
+         case 'x': impairment.dropRate = atof(optarg); break;
+         case 'u': impairment.duplicateRate = atof(optarg); break;
+         case 's': impairment.seed = atoi(optarg); break;
+         case 'n': testCnt = atoi(optarg); break;
+         default: usage(argv[0]); return -1;
+      }
+      impaired = impaired || (opt != 'n');
+   }
+
    //init random number generator
    const unsigned int seed = slay2.getTime1ms();
    cout << "Init with seed=" << seed << endl;
@@ -60,6 +91,10 @@ int main(int argc, char * argv[])
 
    //init communiction driver
    slay2.init();
+   if (impaired)
+   {
+      slay2.setImpairment(&impairment);
+   }
 
    //open communication channels
    for (int i = 0; i < APP_CH_CNT; ++i)
@@ -70,21 +105,34 @@ int main(int argc, char * argv[])
 
    //start test loop
    unsigned int start = slay2.getTime1ms();
-   for (int test = 0; test < APP_TEST_CNT; ++test)
+   unsigned int maxDauer = 0;
+   for (int test = 0; test < testCnt; ++test)
    {
       //init crc
       for (int i = 0; i < APP_CH_CNT; ++i) rxCrc[i] = 0xFFFFFFFFuL;
       //start transfer
+      const unsigned int testStart = impaired ? slay2.getTime1ms() : 0; //(each call advances the virtual time)
       ser[0]->send((const unsigned char *)dummy, dummyLen);
       while (rxCrc[APP_CH_CNT-1] != dummyCrc)
       {
          slay2.task();
       }
+      const unsigned int testDauer = impaired ? (slay2.getTime1ms() - testStart) : 0;
+      maxDauer = (testDauer > maxDauer) ? testDauer : maxDauer;
    }
    unsigned int stop = slay2.getTime1ms();
    const unsigned int dauer = stop - start;
    cout << "Uebertragungsdauer [ms]: " << dauer << endl;
-   cout << "Uebertragungsgeschw [kbps]: " << (1.0*APP_TEST_CNT*dummyLen*(APP_CH_CNT-1))/dauer << endl;
+   cout << "Uebertragungsgeschw [kbps]: " << (1.0*testCnt*dummyLen*(APP_CH_CNT-1))/dauer << endl;
+   if (impaired)
+   {
+      Slay2Stats stats;
+      slay2.getStats(&stats);
+      cout << "Max. Dauer einer Uebertragung [ms]: " << maxDauer << endl;
+      cout << "Retransmissions: " << stats.retransmissions << ", CRC errors: " << stats.crcErrors
+           << ", out of sequence: " << stats.outOfSequence << ", RTT [ms]: " << stats.rttMin << "/" << stats.rttAvg
+           << "/" << stats.rttMax << endl;
+   }
 
    //close channels
    for (int i = 0; i < APP_CH_CNT; ++i)
@@ -0,0 +1,424 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <time.h>
+#include "slay2.h"
+
+using namespace std;
+
+
+extern "C" unsigned int xcrc32(const unsigned char *buf, int len, unsigned int init);
+
+
+/*
+   Micro benchmarks of the building blocks of slay2:
+   -- DATA and ACK codecs (Slay2DataEncodingBuffer/Slay2DataDecodingBuffer, Slay2AckEncodingBuffer/Slay2AckDecodingBuffer)
+   -- CRC calculation (xcrc32)
+   -- TX buffer of a channel (Slay2Fifo)
+   -- selection and acknowledge of data frames (Slay2TxScheduler::getNextXfer/acknowledgeXfer) by the number of
+      ready channels
+   Each benchmark is repeated BENCH_REPEAT times, the fastest run is reported (the least disturbed by the host).
+   The results are written as JSON (to stdout, or to the file given as 1st argument), so they can be compared
+   between versions, e.g.:
+      { "benchmark": "data_encode", "param": 256, "unit": "frame", "ns_per_op": 912.4, "mb_per_s": 280.6 }
+   "param" is the payload length resp. the number of channels, "mb_per_s" refers to the payload bytes (0 if n/a).
+*/
+
+#define BENCH_REPEAT       (5u)
+#define BENCH_MIN_NS       (20000000uLL)       //min. duration of a run [ns]
+#define BENCH_FIFO_SIZE    (16u * 1024u)       //TX buffer of a channel of the scheduler benchmark
+#define BENCH_WINDOW       (16u)               //transmission window of the scheduler benchmark
+
+
+struct BenchResult
+{
+   const char * name;
+   const char * unit; //one operation is ...
+   unsigned int param;
+   unsigned int bytes; //payload bytes per operation (0: n/a)
+   double nsPerOp;
+};
+
+//benchmark function: runs "loops" operations. the returned checksum prevents the compiler from dropping the work
+typedef unsigned int (*BenchFunc)(void * const ctx, const unsigned int loops);
+
+static volatile unsigned int sink;
+static unsigned char pattern[SLAY2_MAX_FRAME_PAYLOAD + 8];
+
+
+
+static unsigned long long now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return 1000000000uLL * ts.tv_sec + ts.tv_nsec;
+}
+
+
+//calibrate the number of loops to BENCH_MIN_NS, and return the time per operation of the fastest run
+static double measure(const BenchFunc func, void * const ctx)
+{
+   unsigned int loops = 1;
+   unsigned long long elapsed = 0;
+   while (true)
+   {
+      const unsigned long long start = now();
+      sink += func(ctx, loops);
+      elapsed = now() - start;
+      if ((elapsed >= (BENCH_MIN_NS / 4)) || (loops >= 0x40000000u))
+      {
+         break;
+      }
+      loops *= 2;
+   }
+   loops = (unsigned int)((double)loops * BENCH_MIN_NS / (elapsed ? elapsed : 1)) + 1;
+   double best = 0;
+   for (unsigned int r = 0; r < BENCH_REPEAT; ++r)
+   {
+      const unsigned long long start = now();
+      sink += func(ctx, loops);
+      const double nsPerOp = (double)(now() - start) / loops;
+      if ((r == 0) || (nsPerOp < best))
+      {
+         best = nsPerOp;
+      }
+   }
+   return best;
+}
+
+
+
+//-- codecs ----------------------------------------------------------------------------------------------------------
+
+struct CodecContext
+{
+   unsigned int len; //payload length resp. number of bitmap bytes
+   Slay2DataEncodingBuffer dataEncoder;
+   Slay2DataDecodingBuffer dataDecoder;
+   Slay2AckEncodingBuffer ackEncoder;
+   Slay2AckDecodingBuffer ackDecoder;
+};
+
+//DATA frame: sequence number, channel number, payload, CRC, end byte
+static void encodeDataFrame(Slay2DataEncodingBuffer * const encoder, const unsigned int len)
+{
+   encoder->flush();
+   encoder->pushData(pattern, len + 2);
+   encoder->pushDataBig32(encoder->getCrc32());
+   encoder->pushEndOfData();
+}
+
+static unsigned int benchDataEncode(void * const ctx, const unsigned int loops)
+{
+   CodecContext * const c = (CodecContext *)ctx;
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      encodeDataFrame(&c->dataEncoder, c->len);
+      sum += c->dataEncoder.getCount();
+   }
+   return sum;
+}
+
+static unsigned int benchDataDecode(void * const ctx, const unsigned int loops)
+{
+   CodecContext * const c = (CodecContext *)ctx;
+   const unsigned char * const frame = c->dataEncoder.getBuffer();
+   const unsigned int count = c->dataEncoder.getCount() - 1; //without end byte
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      c->dataDecoder.flush();
+      c->dataDecoder.pushData(frame, count);
+      sum += c->dataDecoder.isCrcValid(false) ? c->dataDecoder.getCount() : 0;
+   }
+   return sum;
+}
+
+//legacy ACK frame (sequence number, CRC), resp. cumulative ACK frame with "len" bitmap bytes
+static void encodeAckFrame(Slay2AckEncodingBuffer * const encoder, const unsigned int len)
+{
+   encoder->flush();
+   if (len > 0)
+   {
+      encoder->pushAck(SLAY2_ACK_TYPE_CUMULATIVE);
+   }
+   encoder->pushAck(pattern, len + 1);
+   encoder->pushAckBig32(encoder->getCrc32());
+   encoder->pushEndOfAck();
+}
+
+static unsigned int benchAckEncode(void * const ctx, const unsigned int loops)
+{
+   CodecContext * const c = (CodecContext *)ctx;
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      encodeAckFrame(&c->ackEncoder, c->len);
+      sum += c->ackEncoder.getCount();
+   }
+   return sum;
+}
+
+static unsigned int benchAckDecode(void * const ctx, const unsigned int loops)
+{
+   CodecContext * const c = (CodecContext *)ctx;
+   const unsigned char * const frame = c->ackEncoder.getBuffer();
+   const unsigned int count = c->ackEncoder.getCount() - 1; //without end byte
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      c->ackDecoder.flush();
+      c->ackDecoder.pushAck(frame, count);
+      sum += (c->ackDecoder.getCrc32() == 0) ? c->ackDecoder.getCount() : 0;
+   }
+   return sum;
+}
+
+static unsigned int benchCrc(void * const ctx, const unsigned int loops)
+{
+   CodecContext * const c = (CodecContext *)ctx;
+   unsigned int crc = 0xFFFFFFFFu;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      crc = xcrc32(pattern, (int)c->len, crc);
+   }
+   return crc;
+}
+
+
+
+//-- fifo ------------------------------------------------------------------------------------------------------------
+
+struct FifoContext
+{
+   unsigned int len; //bytes per push/pop
+   Slay2Fifo fifo;
+   unsigned char buffer[SLAY2_FIFO_SIZE];
+   unsigned char data[SLAY2_FIFO_SIZE];
+};
+
+static unsigned int benchFifoByte(void * const ctx, const unsigned int loops)
+{
+   FifoContext * const f = (FifoContext *)ctx;
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      f->fifo.push((unsigned char)i);
+      sum += (unsigned int)f->fifo.pop();
+   }
+   return sum;
+}
+
+static unsigned int benchFifoBlock(void * const ctx, const unsigned int loops)
+{
+   FifoContext * const f = (FifoContext *)ctx;
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      f->fifo.pushN(f->data, f->len);
+      sum += f->fifo.popN(f->data, f->len);
+   }
+   return sum;
+}
+
+//the way the scheduler takes the payload of a frame: peek at the (up to two) segments, and drop them
+static unsigned int benchFifoPeek(void * const ctx, const unsigned int loops)
+{
+   FifoContext * const f = (FifoContext *)ctx;
+   const unsigned char * seg[2];
+   unsigned int segLen[2];
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      f->fifo.pushN(f->data, f->len);
+      sum += f->fifo.peek(seg, segLen, f->len) + seg[0][0];
+      f->fifo.drop(f->len);
+   }
+   return sum;
+}
+
+
+
+//-- scheduler -------------------------------------------------------------------------------------------------------
+
+//owner of the channels. the benchmark does not call its task(), so it transmits nothing
+class BenchSlay2 : public Slay2
+{
+public:
+   unsigned int getTime1ms(void) { return 0; }
+   void enterCritical(void) { }
+   void leaveCritical(void) { }
+
+protected:
+   unsigned int getTxCount(void) { return 0; }
+   int transmit(const unsigned char * data, unsigned int len) { return (int)len; }
+   int receive(unsigned char * buffer, unsigned int size) { return 0; }
+};
+
+struct SchedulerContext
+{
+   unsigned int numChannels;
+   Slay2Channel * channels[SLAY2_NUM_CHANNELS];
+   Slay2TxScheduler * scheduler;
+};
+
+//one operation: select a channel, encode its next data frame, and acknowledge it.
+//the application refills the TX buffer of the channel by the payload of the frame, so all channels keep ready
+static unsigned int benchScheduler(void * const ctx, const unsigned int loops)
+{
+   SchedulerContext * const s = (SchedulerContext *)ctx;
+   unsigned int sum = 0;
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      Slay2Buffer * const frame = s->scheduler->getNextXfer(0, s->channels);
+      if (frame == NULL)
+      {
+         return 0;
+      }
+      const unsigned char seqNr = Slay2DataDecodingBuffer::decodeData(frame->getBuffer(), 0);
+      Slay2Channel * const channel = s->channels[Slay2DataDecodingBuffer::decodeData(frame->getBuffer(), 1)];
+      s->scheduler->acknowledgeXfer(seqNr, 0);
+      channel->send(pattern, SLAY2_FRAME_PAYLOAD, true);
+      s->scheduler->updateReady(channel);
+      sum += seqNr;
+   }
+   return sum;
+}
+
+
+
+//-- main ------------------------------------------------------------------------------------------------------------
+
+static void writeJson(ostream & out, const BenchResult * const results, const unsigned int count)
+{
+   out << "{" << endl;
+   out << "   \"suite\": \"slay2_bench\"," << endl;
+   out << "   \"repeat\": " << BENCH_REPEAT << "," << endl;
+   out << "   \"results\": [" << endl;
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      const BenchResult * const r = &results[i];
+      const double mbPerSec = (r->bytes > 0) ? (r->bytes * 1000.0 / r->nsPerOp) : 0.0;
+      out << "      { \"benchmark\": \"" << r->name << "\", \"param\": " << r->param
+          << ", \"unit\": \"" << r->unit << "\", \"ns_per_op\": " << fixed << setprecision(2) << r->nsPerOp
+          << ", \"mb_per_s\": " << setprecision(1) << mbPerSec << " }" << ((i + 1 < count) ? "," : "") << endl;
+   }
+   out << "   ]" << endl;
+   out << "}" << endl;
+}
+
+
+int main(int argc, char * argv[])
+{
+   static const unsigned int payloads[] = { 8, 64, 256, 1024, 4096 };
+   static const unsigned int bitmaps[] = { 0, 4, SLAY2_ACK_BITMAP }; //0: legacy ACK frame
+   static const unsigned int blocks[] = { 16, 64, 256 };
+   static const unsigned int channelCounts[] = { 1, 8, 64, 256 };
+   static BenchResult results[64];
+   unsigned int count = 0;
+
+   for (unsigned int i = 0; i < sizeof(pattern); ++i)
+   {
+      pattern[i] = (unsigned char)rand();
+   }
+
+   //codecs and CRC
+   static CodecContext codec;
+   static unsigned char txBuffer[SLAY2_TX_BUFFER_SIZE(SLAY2_MAX_FRAME_PAYLOAD)];
+   static unsigned char rxBuffer[SLAY2_RX_BUFFER_SIZE(SLAY2_MAX_FRAME_PAYLOAD)];
+   codec.dataEncoder.setBuffer(txBuffer, sizeof(txBuffer));
+   codec.dataDecoder.setBuffer(rxBuffer, sizeof(rxBuffer));
+   for (unsigned int p = 0; p < sizeof(payloads) / sizeof(payloads[0]); ++p)
+   {
+      codec.len = payloads[p];
+      BenchResult encode = { "data_encode", "frame", codec.len, codec.len, measure(&benchDataEncode, &codec) };
+      results[count++] = encode;
+      BenchResult decode = { "data_decode", "frame", codec.len, codec.len, measure(&benchDataDecode, &codec) };
+      results[count++] = decode;
+      BenchResult crc = { "crc32", "span", codec.len, codec.len, measure(&benchCrc, &codec) };
+      results[count++] = crc;
+   }
+   for (unsigned int b = 0; b < sizeof(bitmaps) / sizeof(bitmaps[0]); ++b)
+   {
+      codec.len = bitmaps[b];
+      BenchResult encode = { "ack_encode", "frame", codec.len, 0, measure(&benchAckEncode, &codec) };
+      results[count++] = encode;
+      BenchResult decode = { "ack_decode", "frame", codec.len, 0, measure(&benchAckDecode, &codec) };
+      results[count++] = decode;
+   }
+
+   //fifo
+   static FifoContext fifo;
+   fifo.fifo.setBuffer(fifo.buffer, sizeof(fifo.buffer));
+   fifo.len = 1;
+   BenchResult fifoByte = { "fifo_push_pop", "byte", 1, 1, measure(&benchFifoByte, &fifo) };
+   results[count++] = fifoByte;
+   for (unsigned int b = 0; b < sizeof(blocks) / sizeof(blocks[0]); ++b)
+   {
+      fifo.len = blocks[b];
+      fifo.fifo.flush();
+      fifo.fifo.pushN(fifo.data, 7); //odd fill level, so the blocks wrap around the end of the buffer
+      BenchResult block = { "fifo_pushn_popn", "block", fifo.len, fifo.len, measure(&benchFifoBlock, &fifo) };
+      results[count++] = block;
+      BenchResult peek = { "fifo_peek_drop", "block", fifo.len, fifo.len, measure(&benchFifoPeek, &fifo) };
+      results[count++] = peek;
+   }
+
+   //scheduler: strict priority (the lowest channel is served) and deficit round robin (all channels take turns)
+   for (unsigned int policy = 0; policy < 2; ++policy)
+   {
+      for (unsigned int c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); ++c)
+      {
+         BenchSlay2 slay2;
+         Slay2Pool pool;
+         static Slay2Stats stats;
+         Slay2TxScheduler scheduler(&pool, &stats, BENCH_WINDOW);
+         static SchedulerContext sched;
+         scheduler.setSchedulingPolicy((policy == 0) ? SLAY2_STRICT_PRIORITY : SLAY2_DEFICIT_ROUND_ROBIN);
+         sched.numChannels = channelCounts[c];
+         sched.scheduler = &scheduler;
+         for (unsigned int ch = 0; ch < SLAY2_NUM_CHANNELS; ++ch)
+         {
+            sched.channels[ch] = (ch < sched.numChannels) ? slay2.open(ch, 1, BENCH_FIFO_SIZE) : NULL;
+            if (sched.channels[ch] != NULL)
+            {
+               while (sched.channels[ch]->getTxBufferSpace() > 0)
+               {
+                  sched.channels[ch]->send(pattern, SLAY2_FRAME_PAYLOAD, true);
+               }
+               scheduler.updateReady(sched.channels[ch]);
+            }
+         }
+         BenchResult result = { (policy == 0) ? "scheduler_priority" : "scheduler_drr", "frame", sched.numChannels,
+                                SLAY2_FRAME_PAYLOAD, measure(&benchScheduler, &sched) };
+         results[count++] = result;
+         for (unsigned int ch = 0; ch < sched.numChannels; ++ch)
+         {
+            slay2.close(sched.channels[ch]);
+         }
+      }
+   }
+
+   if (argc > 1)
+   {
+      ofstream file(argv[1]);
+      if (!file)
+      {
+         cerr << "can't open " << argv[1] << endl;
+         return -1;
+      }
+      writeJson(file, results, count);
+      for (unsigned int i = 0; i < count; ++i)
+      {
+         cout << setw(20) << left << results[i].name << right << setw(6) << results[i].param
+              << setw(12) << fixed << setprecision(1) << results[i].nsPerOp << " ns/" << results[i].unit << endl;
+      }
+   }
+   else
+   {
+      writeJson(cout, results, count);
+   }
+   return 0;
+}
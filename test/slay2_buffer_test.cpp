@@ -1,9 +1,252 @@
 #include <iostream>
+#include <thread>
+#include <atomic>
 #include "slay2_buffer.h"
+#include "slay2.h"
+#include "slay2_nullmodem.h"
 
 using namespace std;
 
 
+static unsigned long long testTime1us; //virtual clock of the link tests
+
+//endpoint of the link tests: one Slay2Line per direction, on the virtual clock
+class TestEndpoint : public Slay2
+{
+public:
+   TestEndpoint(Slay2Line * tx, Slay2Line * rx) : tx(tx), rx(rx)
+   {
+      peer = NULL;
+      dataFaults = 0;
+      ackFaults = 0;
+      dropFaults = false;
+      dataFrames = 0;
+      ackFrames = 0;
+      nakFrames = 0;
+   }
+
+   unsigned int getTime1ms(void) { return (unsigned int)(testTime1us / 1000u); }
+   void enterCritical(void) { }
+   void leaveCritical(void) { }
+   //blocking calls run task() of this endpoint (see Slay2::waitEvent). meanwhile the remote endpoint runs, and the virtual
+   //clock goes on
+   bool waitReceived(const unsigned int timeout1ms)
+   {
+      if (peer != NULL)
+      {
+         peer->task();
+      }
+      testTime1us += 1000u * timeout1ms;
+      return false;
+   }
+
+   TestEndpoint * peer; //remote endpoint (NULL: none)
+   //fault injection (deterministic): bit 0 hits the next DATA frame passed to the line, bit 1 the one after, ...
+   unsigned long long dataFaults;
+   unsigned long long ackFaults; //... the frames of the ACK stream (ACK, NAK, HELLO)
+   bool dropFaults; //the frames are lost, instead of being corrupted (a bit is flipped)
+   //frames passed to the line
+   unsigned int dataFrames;
+   unsigned int ackFrames;
+   unsigned int nakFrames;
+
+protected:
+   unsigned int getTxCount(void) { return tx->getTxCount(testTime1us); }
+   int receive(unsigned char * buffer, unsigned int size) { return rx->receive(buffer, size, testTime1us); }
+
+   int transmit(const unsigned char * data, unsigned int len)
+   {
+      //a frame is passed at once (unless the line is full). its last byte tells its stream
+      const bool isData = (len > 0) && Slay2DataDecodingBuffer::isEndOfData(data[len - 1]);
+      const bool isAck = (len > 0) && Slay2AckDecodingBuffer::isEndOfAck(data[len - 1]);
+      unsigned long long * const faults = isData ? &dataFaults : &ackFaults;
+      bool fault = false;
+      if (isData || isAck)
+      {
+         fault = (*faults & 1) != 0;
+         *faults >>= 1;
+         dataFrames += isData ? 1 : 0;
+         ackFrames += isAck ? 1 : 0;
+      }
+      if (isAck)
+      {
+         Slay2AckDecodingBuffer frame;
+         frame.pushAck(data, len - 1);
+         nakFrames += ((frame.getCount() == 6) && (frame.getBuffer()[0] == SLAY2_ACK_TYPE_NAK)) ? 1 : 0;
+      }
+      if (fault && dropFaults)
+      {
+         return (int)len; //lost on the line
+      }
+      if (fault)
+      {
+         unsigned char corrupted[SLAY2_TX_BUFFER_SIZE(SLAY2_MAX_FRAME_PAYLOAD)];
+         memcpy(corrupted, data, len);
+         corrupted[len / 2] ^= 0x01; //the byte keeps its stream (bit 7 and 6 are unchanged)
+         return tx->transmit(corrupted, len, testTime1us);
+      }
+      return tx->transmit(data, len, testTime1us);
+   }
+
+private:
+   Slay2Line * tx;
+   Slay2Line * rx;
+};
+
+//a link of two endpoints. the line from A to B is impaired
+struct TestLink
+{
+   Slay2Line lineAB;
+   Slay2Line lineBA;
+   TestEndpoint a;
+   TestEndpoint b;
+   TestLink(const Slay2Impairment * const impairment) : a(&lineAB, &lineBA), b(&lineBA, &lineAB)
+   {
+      a.peer = &b;
+      b.peer = &a;
+      lineAB.setImpairment(impairment);
+      a.setBaudrate((impairment != NULL) ? impairment->baudrate : 0);
+      b.setBaudrate((impairment != NULL) ? impairment->baudrate : 0);
+   }
+   void run(const unsigned int time1ms) //both endpoints, in steps of 1 ms
+   {
+      for (unsigned int i = 0; i < time1ms; ++i)
+      {
+         a.task();
+         b.task();
+         testTime1us += 1000u;
+      }
+   }
+};
+
+
+static unsigned char testPattern(const unsigned int i)
+{
+   return (unsigned char)((i * 13u) ^ (i >> 8));
+}
+
+//received bytes of a channel, checked against the test pattern
+struct TestReceiver
+{
+   unsigned int count;
+   bool inOrder;
+};
+
+static void testReceive(void * const obj, const unsigned char * const data, const unsigned int len)
+{
+   TestReceiver * const rx = (TestReceiver *)obj;
+   for (unsigned int i = 0; i < len; ++i)
+   {
+      rx->inOrder = rx->inOrder && (data[i] == testPattern(rx->count));
+      ++rx->count;
+   }
+}
+
+//send "total" bytes of the test pattern from A to B (channel 1), for at most "limit1ms". returns the number of bytes sent
+static unsigned int testTransfer(TestLink * const link, Slay2Channel * const tx, const TestReceiver * const rx,
+                                 const unsigned int total, const unsigned int limit1ms)
+{
+   unsigned int sent = 0;
+   for (unsigned int t = 0; (t < limit1ms) && (rx->count < total); ++t)
+   {
+      unsigned char block[SLAY2_FRAME_PAYLOAD];
+      unsigned int len = (tx->getTxBufferSpace() < sizeof(block)) ? tx->getTxBufferSpace() : sizeof(block);
+      len = ((total - sent) < len) ? (total - sent) : len;
+      for (unsigned int i = 0; i < len; ++i)
+      {
+         block[i] = testPattern(sent + i);
+      }
+      sent += tx->send(block, len, (sent + len) < total);
+      link->run(1);
+   }
+   return sent;
+}
+
+
+//keep the TX buffers of the channels full, for "time1ms". each channel is ready for transmission all the time
+static void testSaturate(TestLink * const link, Slay2Channel * const * const tx, const unsigned int count, const unsigned int time1ms)
+{
+   unsigned char block[SLAY2_FIFO_SIZE];
+   memset(block, 0x55, sizeof(block));
+   for (unsigned int t = 0; t < time1ms; ++t)
+   {
+      for (unsigned int i = 0; i < count; ++i)
+      {
+         tx[i]->send(block, tx[i]->getTxBufferSpace());
+      }
+      link->run(1);
+   }
+}
+
+
+//producer thread of the lock-free send test: sends "total" bytes of the test pattern, as fast as the TX buffer permits
+static void testProduce(Slay2Channel * const tx, const unsigned int total, const std::atomic<bool> * const abort)
+{
+   unsigned int sent = 0;
+   while ((sent < total) && (abort->load() == false))
+   {
+      unsigned char block[300];
+      unsigned int len = ((total - sent) < sizeof(block)) ? (total - sent) : sizeof(block);
+      for (unsigned int i = 0; i < len; ++i)
+      {
+         block[i] = testPattern(sent + i);
+      }
+      len = tx->send(block, len, (sent + len) < total);
+      sent += len;
+      if (len == 0)
+      {
+         std::this_thread::yield(); //TX buffer full
+      }
+   }
+}
+
+//batch receiver (deferred delivery): counts its calls, the payloads are checked against the test pattern
+struct TestBatchReceiver
+{
+   TestReceiver rx;
+   unsigned int calls;
+   unsigned int spans;
+   bool terminated; //all payloads are zero terminated
+};
+
+static void testBatchReceive(void * const obj, const Slay2Span * const spans, const unsigned int count)
+{
+   TestBatchReceiver * const batch = (TestBatchReceiver *)obj;
+   ++batch->calls;
+   batch->spans += count;
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      testReceive(&batch->rx, spans[i].data, spans[i].len);
+      batch->terminated = batch->terminated && (spans[i].data[spans[i].len] == 0);
+   }
+}
+
+//received bytes of a channel, checked against the data sent
+struct TestCompare
+{
+   const unsigned char * expected;
+   unsigned int count;
+   bool equal;
+};
+
+static void testCompare(void * const obj, const unsigned char * const data, const unsigned int len)
+{
+   TestCompare * const rx = (TestCompare *)obj;
+   rx->equal = rx->equal && (memcmp(data, &rx->expected[rx->count], len) == 0);
+   rx->count += len;
+}
+
+
+//compress up to SLAY2_LZ_INPUT bytes into "out" (as much as fits into the payload of a frame). returns the compressed size
+static unsigned int testCompress(Slay2Compressor * const compressor, const unsigned char * const data, const unsigned int len,
+                                 unsigned char * const out, unsigned int * const consumed)
+{
+   const unsigned char * const seg[2] = { data, data + len };
+   const unsigned int segLen[2] = { len, 0 };
+   return compressor->compress(seg, segLen, out, SLAY2_FRAME_PAYLOAD, consumed);
+}
+
+
 
 int main(int argc, char * argv[])
 {
@@ -97,6 +340,831 @@ int main(int argc, char * argv[])
 
 
 
+   Slay2DataEncodingBuffer bulkEncoder;
+   Slay2DataDecodingBuffer bulkDecoder;
+   cout << "Bulk DATA Encoder / Decoder Test" << endl;
+   bulkEncoder.pushData((const unsigned char *)dataString, strlen(dataString) + 1);
+   bulkEncoder.pushDataBig32(bulkEncoder.getCrc32());
+   bulkEncoder.pushEndOfData();
+   cout << "Encoded Data Length: " << bulkEncoder.getCount() << endl;
+   cout << "Equal to byte-wise encoding: "
+        << ((bulkEncoder.getCount() == dataCount) && (memcmp(bulkEncoder.getBuffer(), dataEncoder.getBuffer(), dataCount) == 0))
+        << endl; //1 expected
+   bulkDecoder.pushData(bulkEncoder.getBuffer(), bulkEncoder.getCount() - 1); //all, except of the end-of-data byte
+   cout << "Decoded Data Length: " << bulkDecoder.getCount() << endl;
+   cout << "Crc of decodec DATA: " << bulkDecoder.getCrc32() << endl; //0 expected!!!
+   cout << (char *)bulkDecoder.getBuffer() << endl;
+   cout << endl << endl << endl;
+
+
+
+   Slay2DataEncodingBuffer largeEncoder;
+   Slay2DataDecodingBuffer largeDecoder;
+   static unsigned char largeTxBuffer[SLAY2_TX_BUFFER_SIZE(SLAY2_MAX_FRAME_PAYLOAD)];
+   static unsigned char largeRxBuffer[SLAY2_RX_BUFFER_SIZE(SLAY2_MAX_FRAME_PAYLOAD)];
+   static unsigned char largeData[SLAY2_MAX_FRAME_PAYLOAD];
+   cout << "Large DATA Frame Test" << endl;
+   for (i = 0; i < (int)sizeof(largeData); ++i)
+   {
+      largeData[i] = (unsigned char)(i * 7);
+   }
+   cout << "Own buffer too small: " << largeEncoder.pushData(largeData, sizeof(largeData)) << endl; //0 expected
+   largeEncoder.setBuffer(largeTxBuffer, sizeof(largeTxBuffer));
+   largeDecoder.setBuffer(largeRxBuffer, sizeof(largeRxBuffer));
+   largeEncoder.pushData(largeData, sizeof(largeData));
+   largeEncoder.pushDataBig32(largeEncoder.getCrc32());
+   cout << "End of data pushed: " << largeEncoder.pushEndOfData() << endl; //1 expected
+   largeDecoder.pushData(largeEncoder.getBuffer(), largeEncoder.getCount() - 1); //all, except of the end-of-data byte
+   cout << "Decoded Data Length: " << largeDecoder.getCount() << endl; //4096 + 4 expected
+   cout << "Crc of decodec DATA: " << largeDecoder.getCrc32() << endl; //0 expected!!!
+   cout << "Equal to encoded data: " << (memcmp(largeDecoder.getBuffer(), largeData, sizeof(largeData)) == 0) << endl; //1 expected
+   cout << endl << endl << endl;
+
+
+
+   Slay2Fifo fifo;
+   unsigned char fifoBuffer[1024];
+   unsigned char fifoData[700];
+   unsigned char fifoCheck[700];
+   const unsigned char * seg[2];
+   unsigned int segLen[2];
+   cout << "FIFO Span Test" << endl;
+   fifo.setBuffer(fifoBuffer, sizeof(fifoBuffer));
+   for (i = 0; i < (int)sizeof(fifoData); ++i)
+   {
+      fifoData[i] = (unsigned char)i;
+   }
+   fifo.pushN(fifoData, sizeof(fifoData));
+   fifo.drop(600);
+   cout << "Pushed across the wrap around: " << fifo.pushN(fifoData, sizeof(fifoData)) << endl; //700 expected
+   cout << "Pushed into full fifo: " << fifo.pushN(fifoData, sizeof(fifoData)) << endl; //1024 - 800 = 224 expected
+   fifo.drop(100); //the rest of the 1st block. the 2nd block wraps around
+   cout << "Peeked length: " << fifo.peek(seg, segLen, sizeof(fifoData)) << " = " << segLen[0] << " + " << segLen[1] << endl;
+   cout << "Popped length: " << fifo.popN(fifoCheck, sizeof(fifoCheck)) << endl; //700 expected
+   cout << "Equal to pushed data: " << (memcmp(fifoData, fifoCheck, sizeof(fifoData)) == 0) << endl; //1 expected
+   cout << "Remaining count: " << fifo.getCount() << endl; //224 expected
+   cout << endl << endl << endl;
+
+
+
+   Slay2Pool pool;
+   cout << "Pool Test" << endl;
+   void * const block1 = pool.alloc(100);
+   void * const block2 = pool.alloc(128);
+   cout << "Block size of 100 bytes: " << Slay2Pool::getBlockSize(100) << endl; //128 expected
+   cout << "Distinct blocks: " << (block1 != block2) << endl; //1 expected
+   pool.release(block1);
+   void * const block3 = pool.alloc(120);
+   cout << "Released block reused: " << (block3 == block1) << endl; //1 expected
+   pool.release(block2);
+   pool.release(block3);
+   cout << endl << endl << endl;
+
+
+
+   static Slay2Compressor compressor;
+   static Slay2Decompressor decompressor;
+   static const char * const lzLine = "temperature 21.5 C, pressure 1013 hPa, humidity 45 %, state ok\n";
+   const unsigned int lzLineLen = strlen(lzLine);
+   unsigned char lzRandom[200];
+   unsigned char lzPacked[SLAY2_FRAME_PAYLOAD];
+   unsigned char lzUnpacked[SLAY2_LZ_INPUT];
+   unsigned int lzConsumed;
+   unsigned int lzLen;
+   int lzUnpackedLen;
+   cout << "Compression Test" << endl;
+   lzLen = testCompress(&compressor, (const unsigned char *)lzLine, lzLineLen, lzPacked, &lzConsumed);
+   cout << "1st frame resets the dictionary: " << (lzPacked[0] & SLAY2_LZ_FLAG_RESET) << endl; //1 expected
+   compressor.commit(lzConsumed);
+   lzUnpackedLen = decompressor.decompress(lzPacked, lzLen, lzUnpacked);
+   cout << "1st frame decompressed: " << ((lzUnpackedLen == (int)lzLineLen) && (memcmp(lzUnpacked, lzLine, lzLineLen) == 0)) << endl; //1 expected
+   //dictionary carry-over: the 2nd frame refers to the 1st one
+   lzLen = testCompress(&compressor, (const unsigned char *)lzLine, lzLineLen, lzPacked, &lzConsumed);
+   compressor.commit(lzConsumed);
+   cout << "2nd frame compressed length: " << lzLen << endl; //5 expected (header, token, offset, match length)
+   lzUnpackedLen = decompressor.decompress(lzPacked, lzLen, lzUnpacked);
+   cout << "2nd frame decompressed: " << ((lzUnpackedLen == (int)lzLineLen) && (memcmp(lzUnpacked, lzLine, lzLineLen) == 0)) << endl; //1 expected
+   //raw fallback: random data does not compress. the raw frame is part of both dictionaries anyway
+   unsigned int lzSeed = 7;
+   for (i = 0; i < (int)sizeof(lzRandom); ++i)
+   {
+      lzSeed = (lzSeed * 1103515245u) + 12345u;
+      lzRandom[i] = (unsigned char)(lzSeed >> 16);
+   }
+   lzLen = testCompress(&compressor, lzRandom, sizeof(lzRandom), lzPacked, &lzConsumed);
+   cout << "Random data sent raw: " << (lzLen >= lzConsumed) << endl; //1 expected
+   compressor.commit(lzConsumed);
+   decompressor.append(lzRandom, lzConsumed);
+   lzLen = testCompress(&compressor, lzRandom, sizeof(lzRandom), lzPacked, &lzConsumed);
+   compressor.commit(lzConsumed);
+   cout << "Repeated raw frame compressed length: " << lzLen << endl; //5 expected
+   lzUnpackedLen = decompressor.decompress(lzPacked, lzLen, lzUnpacked);
+   cout << "Repeated raw frame decompressed: "
+        << ((lzUnpackedLen == (int)sizeof(lzRandom)) && (memcmp(lzUnpacked, lzRandom, sizeof(lzRandom)) == 0)) << endl; //1 expected
+   //reset: a receiver without the dictionary cannot decompress a frame, that refers to it. after a reset, it can
+   Slay2Decompressor lzFresh;
+   lzLen = testCompress(&compressor, (const unsigned char *)lzLine, lzLineLen, lzPacked, &lzConsumed);
+   cout << "Without the dictionary: " << lzFresh.decompress(lzPacked, lzLen, lzUnpacked) << endl; //-1 expected
+   compressor.reset();
+   lzLen = testCompress(&compressor, (const unsigned char *)lzLine, lzLineLen, lzPacked, &lzConsumed);
+   compressor.commit(lzConsumed);
+   lzUnpackedLen = lzFresh.decompress(lzPacked, lzLen, lzUnpacked);
+   cout << "After a reset: " << ((lzUnpackedLen == (int)lzLineLen) && (memcmp(lzUnpacked, lzLine, lzLineLen) == 0)) << endl; //1 expected
+   lzUnpackedLen = decompressor.decompress(lzPacked, lzLen, lzUnpacked);
+   cout << "After a reset, with an old dictionary: "
+        << ((lzUnpackedLen == (int)lzLineLen) && (memcmp(lzUnpacked, lzLine, lzLineLen) == 0)) << endl; //1 expected
+   cout << endl << endl << endl;
+
+
+
+   //large frames: a raw frame of a compressed channel must not take more input, than the dictionary keeps track of
+   static unsigned char lzStream[2924];
+   TestLink lzLink(NULL);
+   TestCompare lzRx = { lzStream, 0, true };
+   for (i = 0; i < 2524; ++i) //random data: a compressed frame (the 1st one resets the dictionary), then a raw frame
+   {
+      lzSeed = (lzSeed * 1103515245u) + 12345u;
+      lzStream[i] = (unsigned char)(lzSeed >> 16);
+   }
+   memcpy(&lzStream[2524], &lzStream[1224], 400); //refers to the raw frame
+   lzLink.a.setMaxFramePayload(SLAY2_MAX_FRAME_PAYLOAD);
+   lzLink.b.setMaxFramePayload(SLAY2_MAX_FRAME_PAYLOAD);
+   Slay2Channel * const lzTx = lzLink.a.open(2, 1, sizeof(lzStream));
+   lzLink.b.open(2)->setReceiver(&testCompare, &lzRx);
+   lzTx->setCompression(true);
+   lzLink.run(100); //synchronisation, negotiation of large frames
+   cout << "Frame payload: " << lzLink.a.getFramePayload() << endl; //4096 expected
+   lzTx->send(&lzStream[0], 1024);
+   lzLink.run(100);
+   lzTx->send(&lzStream[1024], 1500);
+   lzLink.run(100);
+   lzTx->send(&lzStream[2524], 400);
+   lzLink.run(100);
+   cout << "Received: " << lzRx.count << ", equal: " << lzRx.equal << endl; //2924, 1 expected
+   //the receiver did not open the channel: its compressed frames are acknowledged, but dropped
+   Slay2Stats lzStats;
+   Slay2Channel * const lzUnopened = lzLink.a.open(3);
+   lzUnopened->setCompression(true);
+   lzUnopened->send((const unsigned char *)lzLine, lzLineLen);
+   lzLink.run(100);
+   lzLink.b.getStats(&lzStats);
+   cout << "Unopened channel: " << lzStats.unopenedChannel << ", acknowledged: " << lzUnopened->getAckedByteCount() << endl; //1, 63 expected
+   cout << endl << endl << endl;
+
+
+
+   Slay2ReorderBuffer reorder(&pool);
+   unsigned int reorderLen = 0;
+   cout << "Reorder Buffer Test" << endl;
+   reorder.setSize(4, 16);
+   cout << "Put beyond the buffer: " << reorder.put(4, (const unsigned char *)"E", 1) << endl; //0 expected
+   reorder.put(2, (const unsigned char *)"C", 1);
+   reorder.put(1, (const unsigned char *)"B", 1);
+   cout << "Gap at offset 0: " << (reorder.top(&reorderLen) == NULL) << endl; //1 expected
+   cout << "Frames out of order: " << reorder.getCount() << ", offset 1 valid: " << reorder.isValid(1) << endl; //2, 1 expected
+   reorder.put(0, (const unsigned char *)"A", 1);
+   string reordered;
+   unsigned char * reorderFrame;
+   while ((reorderFrame = reorder.top(&reorderLen)) != NULL)
+   {
+      reordered.append((const char *)reorderFrame, reorderLen);
+      reorder.pop();
+   }
+   cout << "Popped in order: " << reordered << ", remaining: " << reorder.getCount() << endl; //ABC, 0 expected
+   reorder.put(3, (const unsigned char *)"G", 1); //offset 3 is the 4th slot after the 3 pops (wrap around)
+   reorder.pop();
+   reorder.pop();
+   reorder.pop();
+   cout << "Wrapped frame: " << (char)reorder.top(&reorderLen)[0] << endl; //G expected
+   cout << endl << endl << endl;
+
+
+
+   cout << "Selective Repeat Delivery Test" << endl;
+   unsigned long long retransmissions[2];
+   for (unsigned int selective = 0; selective < 2; ++selective) //go-back-N, then selective repeat (same losses)
+   {
+      Slay2Impairment lossy;
+      memset(&lossy, 0, sizeof(lossy));
+      lossy.baudrate = 115200;
+      lossy.delay1ms = 5;
+      lossy.dropRate = 0.0005; //a dropped byte corrupts its frame, the frames behind it arrive out of order
+      lossy.seed = 7;
+      TestLink link(&lossy);
+      TestReceiver rx = { 0, true };
+      link.a.setWindowSize(16);
+      link.b.setWindowSize(16);
+      link.a.setSelectiveRepeat(selective != 0);
+      link.b.setSelectiveRepeat(selective != 0);
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      const unsigned int sent = testTransfer(&link, tx, &rx, 50000, 60000);
+      Slay2Stats statsA;
+      Slay2Stats statsB;
+      link.a.getStats(&statsA);
+      link.b.getStats(&statsB);
+      retransmissions[selective] = statsA.retransmissions;
+      cout << (selective ? "Selective repeat" : "Go-back-N") << ": received " << rx.count << " of " << sent
+           << ", in order: " << rx.inOrder << endl; //50000 of 50000, 1 expected
+      cout << "Frames dropped out of order: " << (statsB.outOfSequence > 0) << endl; //1 (go-back-N), 0 (kept by selective repeat) expected
+   }
+   cout << "Fewer retransmissions: " << (retransmissions[1] < retransmissions[0]) << endl; //1 expected
+   cout << endl << endl << endl;
+
+
+
+   cout << "Cumulative ACK Test" << endl;
+   {
+      //an ACK frame gets lost. the next cumulative ACK frame acknowledges the whole window anyway
+      TestLink link(NULL);
+      TestReceiver rx = { 0, true };
+      link.a.setWindowSize(8);
+      link.b.setWindowSize(8);
+      link.b.setCumulativeAck(true, 2);
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      link.b.ackFaults = 1; //the 1st ACK frame
+      link.b.dropFaults = true;
+      const unsigned int ackFrames = link.b.ackFrames;
+      testTransfer(&link, tx, &rx, 8 * SLAY2_FRAME_PAYLOAD, 100);
+      link.run(20);
+      Slay2Stats stats;
+      link.a.getStats(&stats);
+      cout << "Received: " << rx.count << ", in order: " << rx.inOrder << ", acknowledged: " << tx->getAckedByteCount()
+           << endl; //2048, 1, 2048 expected
+      cout << "ACK frames of 8 data frames: " << (link.b.ackFrames - ackFrames) << ", retransmissions: " << stats.retransmissions
+           << endl; //3, 0 expected (the 1st one got lost)
+   }
+   {
+      //selective repeat: a data frame gets lost. the bitmap acknowledges the frames behind it, so only the lost one is retransmitted
+      TestLink link(NULL);
+      TestReceiver rx = { 0, true };
+      link.a.setWindowSize(8);
+      link.b.setWindowSize(8);
+      link.a.setSelectiveRepeat(true);
+      link.b.setSelectiveRepeat(true);
+      link.b.setCumulativeAck(true, 2);
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      link.a.dataFaults = 2; //the 2nd data frame
+      link.a.dropFaults = true;
+      testTransfer(&link, tx, &rx, 8 * SLAY2_FRAME_PAYLOAD, 3000);
+      Slay2Stats stats;
+      link.a.getStats(&stats);
+      cout << "Received: " << rx.count << ", in order: " << rx.inOrder << ", retransmissions: " << stats.retransmissions
+           << endl; //2048, 1, 1 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   Slay2ChannelSet channelSet;
+   cout << "Channel Set Test" << endl;
+   cout << "Empty: " << channelSet.isEmpty() << ", next: " << channelSet.findNext(0) << endl; //1, -1 expected
+   channelSet.insert(255);
+   channelSet.insert(64);
+   channelSet.insert(63);
+   channelSet.insert(0);
+   cout << "Next of 0, 1, 63, 64, 65, 255: " << channelSet.findNext(0) << " " << channelSet.findNext(1) << " " << channelSet.findNext(63)
+        << " " << channelSet.findNext(64) << " " << channelSet.findNext(65) << " " << channelSet.findNext(255) << endl; //0 63 63 64 255 255 expected
+   cout << "Next beyond the channels: " << channelSet.findNext(256) << endl; //-1 expected
+   channelSet.remove(255);
+   channelSet.remove(63);
+   cout << "Removed 63 and 255: " << channelSet.contains(63) << channelSet.contains(255) << channelSet.contains(64)
+        << ", next of 1, 65: " << channelSet.findNext(1) << " " << channelSet.findNext(65) << endl; //001, 64 -1 expected
+   cout << endl << endl << endl;
+
+
+
+   cout << "Scheduling Policy Test" << endl;
+   {
+      //strict priority (default): a busy channel blocks all channels with higher numbers
+      Slay2Impairment slow;
+      memset(&slow, 0, sizeof(slow));
+      slow.baudrate = 115200;
+      TestLink link(&slow);
+      Slay2Channel * tx[3] = { link.a.open(1), link.a.open(2, 3), link.a.open(3) };
+      link.b.open(1);
+      link.b.open(2);
+      link.b.open(3);
+      link.run(100); //synchronisation
+      testSaturate(&link, tx, 3, 1000);
+      cout << "Strict priority: " << tx[0]->getTxByteCount() << " " << tx[1]->getTxByteCount() << " " << tx[2]->getTxByteCount()
+           << endl; //9984 0 0 expected
+   }
+   {
+      //deficit round robin: the ready channels share the line by their weights (1:2:1). channels 63/64 are in
+      //different words of the set, channel 255 is the last one
+      Slay2Impairment slow;
+      memset(&slow, 0, sizeof(slow));
+      slow.baudrate = 115200;
+      TestLink link(&slow);
+      link.a.setSchedulingPolicy(SLAY2_DEFICIT_ROUND_ROBIN);
+      Slay2Channel * tx[3] = { link.a.open(63), link.a.open(64, 2), link.a.open(255) };
+      link.b.open(63);
+      link.b.open(64);
+      link.b.open(255);
+      link.run(100); //synchronisation
+      testSaturate(&link, tx, 3, 2000);
+      const unsigned int weights[3] = { 1, 2, 1 };
+      const unsigned long long total = tx[0]->getTxByteCount() + tx[1]->getTxByteCount() + tx[2]->getTxByteCount();
+      bool shared = true;
+      cout << "Deficit round robin:";
+      for (unsigned int n = 0; n < 3; ++n)
+      {
+         //the last round may be incomplete: within one frame of the share
+         const long long deviation = (long long)tx[n]->getTxByteCount() - (long long)((total * weights[n]) / 4);
+         shared = shared && (deviation <= SLAY2_FRAME_PAYLOAD) && (deviation >= -SLAY2_FRAME_PAYLOAD);
+         cout << " " << tx[n]->getTxByteCount();
+      }
+      cout << ", shares match the weights: " << shared << endl; //5120 9984 4864, 1 expected
+      Slay2Stats stats;
+      link.b.getStats(&stats);
+      cout << "Received by channel: " << (stats.channels[63].rxBytes == tx[0]->getAckedByteCount())
+           << (stats.channels[64].rxBytes == tx[1]->getAckedByteCount()) << (stats.channels[255].rxBytes == tx[2]->getAckedByteCount())
+           << endl; //111 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "NAK Test" << endl;
+   for (unsigned int selective = 0; selective < 2; ++selective) //go-back-N, then selective repeat
+   {
+      //a corrupted data frame: the receiver requests its retransmission by a single NAK frame, as soon as the next one arrives
+      Slay2Impairment slow;
+      memset(&slow, 0, sizeof(slow));
+      slow.baudrate = 115200;
+      slow.delay1ms = 5;
+      TestLink link(&slow);
+      TestReceiver rx = { 0, true };
+      link.a.setWindowSize(8);
+      link.b.setWindowSize(8);
+      link.a.setSelectiveRepeat(selective != 0);
+      link.b.setSelectiveRepeat(selective != 0);
+      link.b.setNegativeAck(true);
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      link.a.dataFaults = 2; //the 2nd data frame
+      const unsigned int rto = link.a.getRto();
+      const unsigned int start1ms = link.a.getTime1ms();
+      testTransfer(&link, tx, &rx, 8 * SLAY2_FRAME_PAYLOAD, 3000);
+      const unsigned int duration1ms = link.a.getTime1ms() - start1ms;
+      link.run(100);
+      Slay2Stats statsA;
+      Slay2Stats statsB;
+      link.a.getStats(&statsA);
+      link.b.getStats(&statsB);
+      cout << (selective ? "Selective repeat" : "Go-back-N") << ": received " << rx.count << ", in order: " << rx.inOrder
+           << ", CRC errors: " << statsB.crcErrors << ", NAK frames: " << link.b.nakFrames << endl; //2048, 1, 1, 1 expected
+      cout << "Repaired before the RTO: " << (duration1ms < rto) << " (" << duration1ms << " of " << rto << " ms), retransmissions: "
+           << statsA.retransmissions << endl; //1 (291 resp. 239 of 1027 ms), 3 (go-back-N: the frames in flight), 1 (selective repeat) expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Pacing Test" << endl;
+   {
+      //the driver gets the next frame, if its TX buffer drains within the lead time (SLAY2_TX_LEAD_TIME), but at least
+      //below SLAY2_TX_THRESHOLD bytes
+      Slay2Stats paceStats;
+      Slay2TxScheduler scheduler(&pool, &paceStats);
+      const unsigned int baudrates[3] = { 115200, 250000, 3000000 }; //250000: no standard baudrate
+      for (unsigned int n = 0; n < 3; ++n)
+      {
+         scheduler.setBaudrate(baudrates[n]);
+         cout << baudrates[n] << " baud: threshold " << scheduler.getTxThreshold() << ", 1000 bytes take "
+              << scheduler.getTransmissionTime(1000) << " ms" << endl; //24, 87 / 50, 40 / 600, 4 expected
+      }
+      for (unsigned int n = 0; n < 3; ++n)
+      {
+         //the TX buffer of the driver keeps at most the threshold and a frame. the line is busy all the time
+         Slay2Impairment line;
+         memset(&line, 0, sizeof(line));
+         line.baudrate = baudrates[n];
+         TestLink link(&line);
+         Slay2Channel * const tx = link.a.open(1);
+         link.b.open(1);
+         link.run(100); //synchronisation
+         scheduler.setBaudrate(baudrates[n]);
+         unsigned int backlog = 0;
+         unsigned char block[SLAY2_FIFO_SIZE];
+         memset(block, 0x55, sizeof(block));
+         for (unsigned int t = 0; t < 1000; ++t)
+         {
+            tx->send(block, tx->getTxBufferSpace());
+            link.a.task();
+            const unsigned int count = link.lineAB.getTxCount(testTime1us);
+            backlog = (count > backlog) ? count : backlog;
+            link.b.task();
+            testTime1us += 1000u;
+         }
+         const unsigned long long lineBytes = baudrates[n] / 10; //bytes per second (8N1)
+         cout << baudrates[n] << " baud: max. TX buffer " << backlog << " (limit " << (scheduler.getTxThreshold() + SLAY2_TX_BUFFER)
+              << "), payload " << ((100 * tx->getTxByteCount()) / lineBytes) << " % of the line, RTO " << link.a.getRto()
+              << endl; //325 (328), 86 %, 32 / 351 (354), 86 %, 18 / 301 (904), 85 %, 4 expected (encoding: 7 of 8 bits)
+      }
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Retransmission Timeout Test" << endl;
+   {
+      Slay2Impairment delayed; //no errors, but a propagation delay of 20 ms
+      memset(&delayed, 0, sizeof(delayed));
+      delayed.baudrate = 115200;
+      delayed.delay1ms = 20;
+      TestLink link(&delayed);
+      TestReceiver rx = { 0, true };
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      const unsigned int frameTime = link.a.getRto() - SLAY2_RTO_INITIAL; //transmission time of a frame with max. length
+      cout << "Initial RTO: " << link.a.getRto() << " = " << SLAY2_RTO_INITIAL << " + " << frameTime << endl; //1027 = 1000 + 27 expected
+
+      //the data frames get lost: each timeout doubles the RTO, up to SLAY2_RTO_MAX
+      link.a.dataFaults = 0x1F; //the 1st transmission, and 4 retransmissions
+      link.a.dropFaults = true;
+      unsigned char rtoData[100];
+      for (i = 0; i < (int)sizeof(rtoData); ++i)
+      {
+         rtoData[i] = testPattern(i);
+      }
+      tx->send(rtoData, sizeof(rtoData));
+      Slay2Stats stats;
+      unsigned long long retransmissions = 0;
+      cout << "RTO after each timeout:";
+      for (unsigned int t = 0; (t < 60000) && (rx.count < sizeof(rtoData)); ++t)
+      {
+         link.run(1);
+         link.a.getStats(&stats);
+         if (stats.retransmissions > retransmissions)
+         {
+            retransmissions = stats.retransmissions;
+            cout << " " << link.a.getRto();
+         }
+      }
+      cout << endl; //2027 4027 8027 10000 10000 expected
+      //Karn's rule: the acknowledge of a retransmitted frame is ambiguous -> no sample
+      cout << "Received: " << rx.count << ", RTT samples: " << stats.rttCount << endl; //100, 0 expected
+
+      //the acknowledges of frames, that were transmitted once, are samples. the RTO converges to the round trip time
+      rx.count = 0;
+      testTransfer(&link, tx, &rx, 10000, 10000);
+      link.run(100);
+      link.a.getStats(&stats);
+      cout << "RTT samples: " << (stats.rttCount > 0) << ", converged RTO: " << link.a.getRto() << endl; //1, 52 expected (27 + 20 ms delay + ACK + deviation)
+      const unsigned long long rttCount = stats.rttCount;
+      link.b.ackFaults = 1; //the acknowledge of the next frame gets lost
+      link.b.dropFaults = true;
+      tx->send(rtoData, sizeof(rtoData));
+      link.run(200);
+      link.a.getStats(&stats);
+      cout << "Retransmissions: " << (stats.retransmissions - retransmissions) << ", new RTT samples: " << (stats.rttCount - rttCount)
+           << ", RTO: " << link.a.getRto() << endl; //1, 0, 52 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Statistics Test" << endl;
+   {
+      //a known error pattern: 2 corrupted data frames and a corrupted acknowledge. the window holds one frame only, so
+      //each error costs one retransmission
+      Slay2Impairment slow;
+      memset(&slow, 0, sizeof(slow));
+      slow.baudrate = 115200;
+      TestLink link(&slow);
+      TestReceiver rx1 = { 0, true };
+      TestReceiver rx2 = { 0, true };
+      link.a.setWindowSize(1);
+      link.b.setWindowSize(1);
+      Slay2Channel * const tx1 = link.a.open(1);
+      Slay2Channel * const tx2 = link.a.open(2);
+      link.b.open(1)->setReceiver(&testReceive, &rx1);
+      link.b.open(2)->setReceiver(&testReceive, &rx2);
+      link.run(100); //synchronisation
+      link.a.resetStats();
+      link.b.resetStats();
+      link.a.dataFaults = 0x12; //the 2nd and 5th data frame (retransmissions included)
+      link.b.ackFaults = 0x04; //the 3rd acknowledge
+      unsigned char statsData[600];
+      for (i = 0; i < (int)sizeof(statsData); ++i)
+      {
+         statsData[i] = testPattern(i);
+      }
+      tx1->send(statsData, 600); //3 frames
+      tx2->send(statsData, 300); //2 frames
+      link.run(5000);
+      Slay2Stats statsA;
+      Slay2Stats statsB;
+      link.a.getStats(&statsA);
+      link.b.getStats(&statsB);
+      cout << "Received: " << rx1.count << " " << rx2.count << ", in order: " << (rx1.inOrder && rx2.inOrder) << endl; //600 300, 1 expected
+      cout << "Data frames: " << statsA.txFrames << " sent, " << statsB.rxFrames << " received, " << link.a.dataFrames
+           << " on the line" << endl; //5 sent, 5 received, 8 on the line expected
+      cout << "Retransmissions: " << statsA.retransmissions << ", CRC errors: " << statsB.crcErrors << " (data) " << statsA.crcErrors
+           << " (ACK), out of sequence: " << statsB.outOfSequence << endl; //3, 2 1, 1 expected
+      cout << "Bytes: " << statsA.txBytes << " " << statsB.rxBytes << ", channel 1: " << statsA.channels[1].txBytes << " "
+           << statsB.channels[1].rxBytes << ", channel 2: " << statsA.channels[2].txBytes << " " << statsB.channels[2].rxBytes
+           << ", frames of channel 2: " << statsB.channels[2].rxFrames << endl; //900 900, 600 600, 300 300, 2 expected
+      cout << "Other drops: " << (statsB.unopenedChannel + statsB.deliveryDrops + statsB.decompressionErrors + statsB.syncResets)
+           << ", RTT samples: " << statsA.rttCount << ", task calls: " << statsA.taskCount << endl; //0, 3 (frames transmitted once), 5000 expected
+      link.a.resetStats();
+      link.a.getStats(&statsA);
+      cout << "After resetStats: " << (statsA.txFrames + statsA.retransmissions + statsA.channels[1].txBytes + statsA.rttCount) << endl; //0 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Lock-free Send Test" << endl;
+   {
+      //a producer thread sends without the critical section. task() picks up the channel by collectSent()
+      TestLink link(NULL);
+      TestReceiver rx = { 0, true };
+      std::atomic<bool> abort(false);
+      link.a.setWindowSize(8);
+      link.b.setWindowSize(8);
+      Slay2Channel * const tx = link.a.open(1);
+      Slay2Channel * const rxChannel = link.b.open(1);
+      rxChannel->setReceiver(&testReceive, &rx);
+      tx->setLockFree(true);
+      link.run(100); //synchronisation
+      std::thread producer(&testProduce, tx, 100000u, &abort);
+      //the virtual time runs much faster than the producer. so the limit is generous
+      for (unsigned int t = 0; (t < 10000000) && (rx.count < 100000); ++t)
+      {
+         link.run(1);
+      }
+      abort = true;
+      producer.join();
+      cout << "Received: " << rx.count << ", in order: " << rx.inOrder << endl; //100000, 1 expected
+      cout << "Sent byte count: " << tx->getSentByteCount() << endl; //100000 expected
+
+      //channels of different words of the bitmap, sent by turns
+      TestCompare rx40 = { lzStream, 0, true };
+      TestReceiver rx1 = { 0, true };
+      Slay2Channel * const tx40 = link.a.open(40);
+      tx40->setLockFree(true);
+      link.b.open(40)->setReceiver(&testCompare, &rx40);
+      rxChannel->setReceiver(&testReceive, &rx1);
+      unsigned char block[100];
+      for (unsigned int n = 0; n < 20; ++n)
+      {
+         for (i = 0; i < (int)sizeof(block); ++i)
+         {
+            block[i] = testPattern((n * sizeof(block)) + i);
+         }
+         tx->send(block, sizeof(block));
+         tx40->send(&lzStream[n * sizeof(block)], sizeof(block));
+         link.run(5);
+      }
+      link.run(100);
+      cout << "Channel 1: " << rx1.count << ", in order: " << rx1.inOrder
+           << ", channel 40: " << rx40.count << ", equal: " << rx40.equal << endl; //2000, 1, 2000, 1 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Delivery Queue Test" << endl;
+   {
+      //records of 20 bytes take 28 bytes (4 byte header, zero termination, 4-byte aligned)
+      Slay2DeliveryQueue queue;
+      unsigned char queueBuffer[64];
+      unsigned char queueChannel;
+      unsigned int queueLen;
+      unsigned int queuePos;
+      const unsigned char * queueData;
+      queue.setBuffer(queueBuffer, sizeof(queueBuffer));
+      queue.push(1, (const unsigned char *)"first record 0123456", 20);
+      queue.push(2, (const unsigned char *)"second record 012345", 20);
+      cout << "Space for a 3rd record: " << queue.hasSpace(20) << endl; //0 expected
+      queuePos = queue.getReadPosition();
+      queueData = queue.peek(&queuePos, &queueChannel, &queueLen);
+      cout << "1st record: " << (const char *)queueData << ", channel " << (unsigned int)queueChannel << endl; //first record 0123456, channel 1 expected
+      queue.release(queuePos);
+      //8 bytes are left up to the end of the buffer: they are padded, the record wraps around to the begin
+      cout << "Pushed across the end: " << queue.push(3, (const unsigned char *)"third record 0123456", 20) << endl; //1 expected
+      string queued;
+      while ((queueData = queue.peek(&queuePos, &queueChannel, &queueLen)) != NULL)
+      {
+         queued.append((const char *)queueData, queueLen);
+         queued.append(" ");
+      }
+      queue.release(queuePos);
+      cout << "Records after the padding: " << queued << endl; //second record 012345 third record 0123456 expected
+      cout << "Wrapped record at the begin: " << (queueData == NULL) << (memcmp(&queueBuffer[4], "third", 5) == 0) << endl; //11 expected
+      cout << "Empty: " << queue.isEmpty() << endl; //1 expected
+   }
+   {
+      //channel 1 with a batch receiver, channel 2 with a receiver. delivered by deliverQueued()
+      TestLink link(NULL);
+      TestBatchReceiver batch = { { 0, true }, 0, 0, true };
+      TestReceiver rx = { 0, true };
+      link.b.setDeferredDelivery(true, false);
+      Slay2Channel * const tx1 = link.a.open(1);
+      Slay2Channel * const tx2 = link.a.open(2);
+      link.b.open(1)->setBatchReceiver(&testBatchReceive, &batch);
+      link.b.open(2)->setReceiver(&testReceive, &rx);
+      link.run(100); //synchronisation
+      unsigned char block[10];
+      for (unsigned int n = 0; n < 5; ++n)
+      {
+         for (i = 0; i < (int)sizeof(block); ++i)
+         {
+            block[i] = testPattern((n * sizeof(block)) + i);
+         }
+         tx1->send(block, sizeof(block)); //a frame per send() (no more flag)
+         link.run(5);
+         tx2->send(block, sizeof(block));
+         link.run(5);
+      }
+      link.run(100);
+      cout << "Delivered before deliverQueued(): " << (batch.rx.count + rx.count) << endl; //0 expected
+      cout << "Payloads delivered: " << link.b.deliverQueued() << endl; //10 expected
+      cout << "Batch receiver: " << batch.calls << " call(s), " << batch.spans << " payloads, " << batch.rx.count
+           << " bytes, in order: " << batch.rx.inOrder << ", zero terminated: " << batch.terminated << endl; //1 call(s), 5 payloads, 50 bytes, 1, 1 expected
+      cout << "Receiver: " << rx.count << " bytes, in order: " << rx.inOrder << endl; //50 bytes, 1 expected
+
+      //the queue is not served for a while: frames are not acknowledged, but retransmitted later
+      batch.rx.count = 0;
+      Slay2Stats stats;
+      const unsigned int total = 3 * SLAY2_DELIVERY_QUEUE;
+      unsigned int sent = 0;
+      for (unsigned int t = 0; t < 3000; ++t)
+      {
+         unsigned char data[SLAY2_FIFO_SIZE];
+         unsigned int len = tx1->getTxBufferSpace();
+         len = ((total - sent) < len) ? (total - sent) : len;
+         for (unsigned int j = 0; j < len; ++j)
+         {
+            data[j] = testPattern(sent + j);
+         }
+         sent += tx1->send(data, len, true);
+         link.run(1);
+      }
+      link.b.getStats(&stats);
+      cout << "Dropped while the queue is full: " << (stats.deliveryDrops > 0) << endl; //1 expected
+      for (unsigned int t = 0; (t < 60000) && (batch.rx.count < total); ++t)
+      {
+         unsigned char data[SLAY2_FIFO_SIZE];
+         unsigned int len = tx1->getTxBufferSpace();
+         len = ((total - sent) < len) ? (total - sent) : len;
+         for (unsigned int j = 0; j < len; ++j)
+         {
+            data[j] = testPattern(sent + j);
+         }
+         sent += tx1->send(data, len, (sent + len) < total);
+         link.run(1);
+         link.b.deliverQueued();
+      }
+      cout << "Received: " << batch.rx.count << " of " << total << ", in order: " << batch.rx.inOrder << endl; //49152 of 49152, 1 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "RX Ring Test" << endl;
+   {
+      //nobody reads: the RX ring fills up, further frames are not acknowledged
+      TestLink link(NULL);
+      Slay2Channel * const tx = link.a.open(1);
+      Slay2Channel * const rxRing = link.b.open(1, 1, SLAY2_FIFO_SIZE, 1024);
+      unsigned char ringData[SLAY2_FIFO_SIZE];
+      link.run(100); //synchronisation
+      const unsigned int total = 5000;
+      unsigned int sent = 0;
+      for (unsigned int t = 0; t < 2000; ++t)
+      {
+         unsigned int len = tx->getTxBufferSpace();
+         len = ((total - sent) < len) ? (total - sent) : len;
+         for (unsigned int j = 0; j < len; ++j)
+         {
+            ringData[j] = testPattern(sent + j);
+         }
+         sent += tx->send(ringData, len, true);
+         link.run(1);
+      }
+      Slay2Stats stats;
+      link.b.getStats(&stats);
+      cout << "RX ring: " << rxRing->getRxCount() << " bytes, dropped frames: " << (stats.deliveryDrops > 0) << endl; //1024, 1 expected
+      cout << "Peeked: " << rxRing->peek(ringData, 10) << ", remaining: " << rxRing->getRxCount() << endl; //10, 1024 expected
+      bool ringInOrder = true;
+      for (i = 0; i < 10; ++i)
+      {
+         ringInOrder = ringInOrder && (ringData[i] == testPattern(i));
+      }
+      //read the ring, the transmitter continues
+      unsigned int received = 0;
+      for (unsigned int t = 0; (t < 60000) && (received < total); ++t)
+      {
+         const int count = rxRing->read(ringData, sizeof(ringData), 10); //runs task() of both endpoints, while it waits
+         for (int j = 0; j < count; ++j)
+         {
+            ringInOrder = ringInOrder && (ringData[j] == testPattern(received + j));
+         }
+         received += (unsigned int)count;
+         unsigned int len = tx->getTxBufferSpace();
+         len = ((total - sent) < len) ? (total - sent) : len;
+         for (unsigned int j = 0; j < len; ++j)
+         {
+            ringData[j] = testPattern(sent + j);
+         }
+         sent += tx->send(ringData, len, (sent + len) < total);
+         link.run(1);
+      }
+      cout << "Read: " << received << " of " << total << ", in order: " << ringInOrder << endl; //5000 of 5000, 1 expected
+      const unsigned long long start1us = testTime1us;
+      cout << "Read of an empty ring: " << rxRing->read(ringData, sizeof(ringData), 10) << ", waited [ms]: "
+           << ((testTime1us - start1us) / 1000u) << endl; //0, 10 expected
+      cout << "Read without an RX ring: " << link.b.open(2)->read(ringData, sizeof(ringData)) << endl; //-1 expected
+   }
+   {
+      //large frames are enabled after the channel is open: the 1 KB ring is reallocated (and keeps its data)
+      TestLink link(NULL);
+      Slay2Channel * const tx = link.a.open(1, 1, 2 * SLAY2_MAX_FRAME_PAYLOAD);
+      Slay2Channel * const rxRing = link.b.open(1, 1, SLAY2_FIFO_SIZE, 1024);
+      static unsigned char largeData[SLAY2_MAX_FRAME_PAYLOAD + 10];
+      link.run(100); //synchronisation
+      for (i = 0; i < (int)sizeof(largeData); ++i)
+      {
+         largeData[i] = testPattern(i);
+      }
+      tx->send(largeData, 10);
+      link.run(100);
+      const bool grown = link.a.setMaxFramePayload(SLAY2_MAX_FRAME_PAYLOAD) && link.b.setMaxFramePayload(SLAY2_MAX_FRAME_PAYLOAD);
+      link.run(100); //re-synchronisation and negotiation
+      cout << "Rings grown: " << grown << ", kept: " << rxRing->getRxCount() << ", frame payload: " << link.b.getFramePayload() << endl; //1, 10, 4096 expected
+      tx->send(&largeData[10], SLAY2_MAX_FRAME_PAYLOAD);
+      link.run(100); //the frame does not fit behind the kept data: it is not acknowledged, until the ring is read
+      int count = rxRing->read(largeData, sizeof(largeData));
+      count += rxRing->read(&largeData[count], sizeof(largeData) - count, 1000); //no I/O thread: read() runs task() (retransmission)
+      bool largeInOrder = true;
+      for (i = 0; i < count; ++i)
+      {
+         largeInOrder = largeInOrder && (largeData[i] == testPattern(i));
+      }
+      cout << "Read of a large frame: " << count << ", in order: " << largeInOrder << endl; //4106, 1 expected
+   }
+   cout << endl << endl << endl;
+
+
+
+   cout << "Acknowledged Offset Test" << endl;
+   {
+      Slay2Impairment slow; //no errors, but frames take their time on the line
+      memset(&slow, 0, sizeof(slow));
+      slow.baudrate = 115200;
+      slow.delay1ms = 5;
+      TestLink link(&slow);
+      TestReceiver rx = { 0, true };
+      Slay2Channel * const tx = link.a.open(1);
+      link.b.open(1)->setReceiver(&testReceive, &rx);
+      unsigned char offsetData[1000];
+      for (i = 0; i < (int)sizeof(offsetData); ++i)
+      {
+         offsetData[i] = testPattern(i);
+      }
+      link.run(100); //synchronisation
+      //more data is announced: the last partial frame is kept back
+      tx->send(offsetData, sizeof(offsetData), true);
+      link.run(200);
+      cout << "Sent: " << tx->getSentByteCount() << ", acknowledged: " << tx->getAckedByteCount() << endl; //1000, 768 expected
+      cout << "Flushed and acknowledged at once: " << tx->flushAndWait(0) << endl; //0 expected (no timeout)
+      //no I/O thread: flushAndWait() runs task() itself, until the data is acknowledged
+      const unsigned long long start1us = testTime1us;
+      const bool flushed = tx->flushAndWait(500);
+      cout << "Flushed and acknowledged: " << flushed << ", acknowledged: " << tx->getAckedByteCount() << ", within 100 ms: "
+           << ((testTime1us - start1us) < 100000u) << endl; //1, 1000, 1 expected
+
+      //a re-synchronisation drops the frames of the window. the acknowledged offset skips them
+      tx->send(offsetData, sizeof(offsetData));
+      link.run(10); //the 1st frame is on the line
+      link.a.setWindowSize(3);
+      link.run(300);
+      const unsigned long long dropped = tx->getDroppedByteCount();
+      cout << "Dropped by the re-synchronisation: " << dropped << endl; //256 expected (the frame arrived, its acknowledge did not)
+      cout << "Acknowledged: " << tx->getAckedByteCount() << " of " << tx->getSentByteCount()
+           << ", flushed and acknowledged: " << tx->flushAndWait(0) << endl; //2000 of 2000, 1 expected
+
+      //flushTxBuffer() drops the data, that was not transmitted yet
+      tx->send(offsetData, sizeof(offsetData), true);
+      tx->flushTxBuffer();
+      cout << "Dropped by flushTxBuffer(): " << (tx->getDroppedByteCount() - dropped) << ", acknowledged: "
+           << tx->getAckedByteCount() << " of " << tx->getSentByteCount() << endl; //1000, 3000 of 3000 expected
+   }
+   cout << endl << endl << endl;
+
+
+
    cout << "Test Ende" << endl;
    return 0;
 }
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+#endif
+
+using namespace std;
+
+
+extern "C" unsigned int xcrc32(const unsigned char *buf, int len, unsigned int init);
+
+
+/*
+   Micro benchmark of the CRC calculation.
+   "before": one xcrc32 call per byte (that is how Slay2Buffer::addToCrc used to work) and the
+             original byte-wise table lookup
+   "after":  one xcrc32 call per span (slice-by-8 resp. PCLMULQDQ folding)
+   On x86 the result is given in TSC cycles per byte, otherwise in nanoseconds per byte.
+*/
+
+#define BENCH_BYTES  (16u * 1024u * 1024u) //number of bytes to be processed per measurement
+
+
+//that is the original (byte-wise, table driven) implementation of xcrc32
+static unsigned int crc32_table[256];
+
+static void crc32_bytewise_init(void)
+{
+   for (unsigned int i = 0; i < 256; ++i)
+   {
+      unsigned int c = i << 24;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+         c = (c & 0x80000000u) ? ((c << 1) ^ 0x04c11db7u) : (c << 1);
+      }
+      crc32_table[i] = c;
+   }
+}
+
+static unsigned int crc32_bytewise(const unsigned char * buf, int len, unsigned int crc)
+{
+   while (len--)
+   {
+      crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buf) & 255];
+      buf++;
+   }
+   return crc;
+}
+
+
+static unsigned long long now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return 1000000000uLL * ts.tv_sec + ts.tv_nsec;
+#endif
+}
+
+
+static unsigned int crcPerByteCall(const unsigned char * buf, unsigned int len, unsigned int crc)
+{
+   for (unsigned int i = 0; i < len; ++i)
+   {
+      crc = xcrc32(&buf[i], 1, crc);
+   }
+   return crc;
+}
+
+static unsigned int crcSpan(const unsigned char * buf, unsigned int len, unsigned int crc)
+{
+   return xcrc32(buf, (int)len, crc);
+}
+
+static unsigned int crcReference(const unsigned char * buf, unsigned int len, unsigned int crc)
+{
+   return crc32_bytewise(buf, (int)len, crc);
+}
+
+
+static double measure(unsigned int (*crcFunc)(const unsigned char *, unsigned int, unsigned int),
+                      const unsigned char * buf, unsigned int len, unsigned int * result)
+{
+   const unsigned int loops = BENCH_BYTES / len;
+   unsigned int crc = 0xFFFFFFFFu;
+   crcFunc(buf, len, crc); //warm up
+   const unsigned long long start = now();
+   for (unsigned int i = 0; i < loops; ++i)
+   {
+      crc = crcFunc(buf, len, crc);
+   }
+   const unsigned long long stop = now();
+   *result = crc;
+   return (double)(stop - start) / ((double)loops * len);
+}
+
+
+int main(int argc, char * argv[])
+{
+   static const unsigned int sizes[] = { 8, 64, 262, 1024, 4096 }; //262: 256 payload bytes + seqNr + channel + crc
+   static unsigned char buf[4096];
+   bool ok = true;
+
+   crc32_bytewise_init();
+   for (unsigned int i = 0; i < sizeof(buf); ++i)
+   {
+      buf[i] = (unsigned char)rand();
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+   cout << "CRC32 benchmark [cycles/byte]" << endl;
+#else
+   cout << "CRC32 benchmark [ns/byte]" << endl;
+#endif
+   cout << setw(8) << "bytes" << setw(14) << "reference" << setw(14) << "per-byte" << setw(14) << "span" << endl;
+   for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+   {
+      const unsigned int len = sizes[s];
+      unsigned int crc[3];
+      const double ref = measure(&crcReference, buf, len, &crc[0]);
+      const double perByte = measure(&crcPerByteCall, buf, len, &crc[1]);
+      const double span = measure(&crcSpan, buf, len, &crc[2]);
+      cout << setw(8) << len << fixed << setprecision(2)
+           << setw(14) << ref << setw(14) << perByte << setw(14) << span << endl;
+      if ((crc[0] != crc[1]) || (crc[0] != crc[2]))
+      {
+         cout << "CRC mismatch for " << len << " bytes!" << endl;
+         ok = false;
+      }
+   }
+   return ok ? 0 : -1;
+}
@@ -1,4 +1,6 @@
 #include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
 #include <iostream>
 #include "slay2_linux.h"
 
@@ -36,6 +38,21 @@ int main(int argc, char * argv[])
 
    cout << "Testing Linux TTY device driver." << endl;
 
+   //custom baudrate (termios2). a pseudo terminal accepts any baudrate. the timing of the protocol is derived from it
+   {
+      Slay2Linux pty;
+      const int master = posix_openpt(O_RDWR | O_NOCTTY);
+      const bool opened = (master >= 0) && (grantpt(master) == 0) && (unlockpt(master) == 0);
+      cout << "Initializing a file, that is no tty, returned " << pty.init("/dev/null", 250000u) << endl; //0 expected
+      cout << "Initializing a pseudo terminal with 250000 baud returned " << (opened && pty.init(ptsname(master), 250000u)) << endl; //1 expected
+      cout << "Retransmission timeout: " << pty.getRto() << "ms" << endl; //1013 expected (1000 + 13 ms transmission time of a frame)
+      pty.shutdown();
+      if (master >= 0)
+      {
+         close(master);
+      }
+   }
+
    //initialization
    status = tty.init(devName, 115200uL);
    cout << "Initializing " << devName << " returned " << status << endl;
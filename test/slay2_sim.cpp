@@ -0,0 +1,426 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "slay2.h"
+#include "slay2_nullmodem.h"
+
+using namespace std;
+
+/*
+   Discrete-event simulation of two slay2 endpoints, interconnected by a virtual serial line (one Slay2Line per
+   direction, with the impairments of slay2_nullmodem.h).
+
+   Both endpoints share a virtual clock. The line knows, when each byte is transmitted (byte time of the baudrate) and
+   when it arrives at the remote endpoint (propagation delay). The clock jumps from event to event:
+   -- arrival of a control byte (SYNC, end of frame), which makes the receiver act
+   -- the deadline of an endpoint (getIdleTime): its TX buffer is drained, a retransmission timeout, a delayed ACK
+   -- the next message of the application
+   So hours of link time are simulated within seconds, and the results are reproducible (given the same seed).
+
+   Each endpoint sends messages on all channels (full duplex). A message carries its send time and a sequence number,
+   so the receiver checks the data and measures the latency (from send() until the receive callback).
+   Without a message interval, the channels keep their TX buffers filled (throughput), otherwise each channel sends one
+   message per interval (latency at a given load).
+*/
+
+#define SIM_WARMUP_US      (200000u)   //time for synchronisation, before the application starts to send
+#define SIM_MSG_HEADER     (12u)       //send time (8 bytes), sequence number (4 bytes)
+#define SIM_MSG_MAX        (4096u)
+#define SIM_HIST_BIN_US    (100u)      //resolution of the latency histogram
+#define SIM_HIST_BINS      (100000u)   //... up to 10 s
+#define SIM_MAX_SAME_TIME  (1000u)     //max. number of events at the same time, before the clock is forced on (1 ms)
+
+
+static unsigned long long simTime1us; //virtual clock
+
+struct SimConfig
+{
+   Slay2Impairment impairment;
+   unsigned int channels;
+   unsigned int msgSize;
+   unsigned int interval1ms; //0: keep the TX buffers filled
+   unsigned int duration1s;
+   unsigned int windowSize;
+   unsigned int framePayload;
+   bool selectiveRepeat;
+   bool cumulativeAck;
+   bool negativeAck;
+   bool roundRobin;
+   bool deferredDelivery;
+};
+
+static SimConfig config;
+
+
+
+class SimEndpoint : public Slay2
+{
+public:
+   SimEndpoint(Slay2Line * tx, Slay2Line * rx) : tx(tx), rx(rx) { }
+
+   unsigned int getTime1ms(void) { return (unsigned int)(simTime1us / 1000u); }
+   void enterCritical(void) { }
+   void leaveCritical(void) { }
+
+protected:
+   unsigned int getTxCount(void) { return tx->getTxCount(simTime1us); }
+   int transmit(const unsigned char * data, unsigned int len) { return tx->transmit(data, len, simTime1us); }
+   int receive(unsigned char * buffer, unsigned int size) { return rx->receive(buffer, size, simTime1us); }
+
+private:
+   Slay2Line * tx;
+   Slay2Line * rx;
+};
+
+
+
+//statistics of one direction
+struct SimDirection
+{
+   unsigned long long bytes;
+   unsigned long long messages;
+   unsigned long long latencySum1us;
+   unsigned long long latencyMin1us;
+   unsigned long long latencyMax1us;
+   unsigned int histogram[SIM_HIST_BINS];
+   bool corrupt;
+};
+
+//a channel of an endpoint: transmitter of the messages, and receiver of the messages of the remote endpoint
+struct SimChannel
+{
+   Slay2Channel * channel;
+   SimDirection * rxDirection;
+   unsigned int txSeqNr;
+   unsigned long long nextTx1us;
+   unsigned int rxSeqNr;
+   unsigned int rxCount; //bytes of the current message
+   unsigned char rxMessage[SIM_MSG_MAX];
+};
+
+
+static void putLe(unsigned char * const p, unsigned long long value, const unsigned int len)
+{
+   for (unsigned int i = 0; i < len; ++i, value >>= 8)
+   {
+      p[i] = (unsigned char)value;
+   }
+}
+
+static unsigned long long getLe(const unsigned char * const p, const unsigned int len)
+{
+   unsigned long long value = 0;
+   for (unsigned int i = len; i > 0; --i)
+   {
+      value = (value << 8) | p[i - 1];
+   }
+   return value;
+}
+
+
+static void sendMessage(SimChannel * const ch)
+{
+   unsigned char msg[SIM_MSG_MAX];
+   putLe(&msg[0], simTime1us, 8);
+   putLe(&msg[8], ch->txSeqNr, 4);
+   for (unsigned int i = SIM_MSG_HEADER; i < config.msgSize; ++i)
+   {
+      msg[i] = (unsigned char)(ch->txSeqNr + i);
+   }
+   //without an interval, the next message follows at once, if the TX buffer keeps it. otherwise the last (partial) frame
+   //of the message is sent at once: with "more", it would wait for data, that does not come
+   const bool more = (config.interval1ms == 0) && (ch->channel->getTxBufferSpace() >= 2 * config.msgSize);
+   ch->channel->send(msg, config.msgSize, more);
+   ++ch->txSeqNr;
+}
+
+
+//send the messages, that are due. returns the time of the next message
+static unsigned long long generateTraffic(SimChannel * const channels)
+{
+   unsigned long long next = ~0uLL;
+   if (simTime1us < SIM_WARMUP_US)
+   {
+      return SIM_WARMUP_US;
+   }
+   for (unsigned int i = 0; i < config.channels; ++i)
+   {
+      SimChannel * const ch = &channels[i];
+      if (config.interval1ms == 0)
+      {
+         while (ch->channel->getTxBufferSpace() >= config.msgSize)
+         {
+            sendMessage(ch);
+         }
+      }
+      else
+      {
+         ch->nextTx1us = (ch->nextTx1us > SIM_WARMUP_US) ? ch->nextTx1us : SIM_WARMUP_US;
+         if ((ch->nextTx1us <= simTime1us) && (ch->channel->getTxBufferSpace() >= config.msgSize))
+         {
+            sendMessage(ch);
+            ch->nextTx1us += 1000uLL * config.interval1ms;
+         }
+         next = (ch->nextTx1us < next) ? ch->nextTx1us : next;
+      }
+   }
+   return next;
+}
+
+
+static void onReceive(void * const obj, const unsigned char * const data, const unsigned int len)
+{
+   SimChannel * const ch = (SimChannel *)obj;
+   SimDirection * const dir = ch->rxDirection;
+   dir->bytes += len;
+   for (unsigned int i = 0; i < len; ++i)
+   {
+      ch->rxMessage[ch->rxCount++] = data[i];
+      if (ch->rxCount < config.msgSize)
+      {
+         continue;
+      }
+      //message complete: check it, and take its latency
+      ch->rxCount = 0;
+      const unsigned long long sent1us = getLe(&ch->rxMessage[0], 8);
+      const unsigned int seqNr = (unsigned int)getLe(&ch->rxMessage[8], 4);
+      bool ok = (seqNr == ch->rxSeqNr) && (sent1us <= simTime1us);
+      for (unsigned int k = SIM_MSG_HEADER; ok && (k < config.msgSize); ++k)
+      {
+         ok = (ch->rxMessage[k] == (unsigned char)(seqNr + k));
+      }
+      if (ok == false)
+      {
+         dir->corrupt = true;
+      }
+      ch->rxSeqNr = seqNr + 1;
+      const unsigned long long latency1us = simTime1us - sent1us;
+      const unsigned long long bin = latency1us / SIM_HIST_BIN_US;
+      ++dir->histogram[(bin < SIM_HIST_BINS) ? bin : (SIM_HIST_BINS - 1)];
+      dir->latencySum1us += latency1us;
+      dir->latencyMin1us = ((dir->messages == 0) || (latency1us < dir->latencyMin1us)) ? latency1us : dir->latencyMin1us;
+      dir->latencyMax1us = (latency1us > dir->latencyMax1us) ? latency1us : dir->latencyMax1us;
+      ++dir->messages;
+   }
+}
+
+
+static void onReceiveBatch(void * const obj, const Slay2Span * const spans, const unsigned int count)
+{
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      onReceive(obj, spans[i].data, spans[i].len);
+   }
+}
+
+
+//latency [ms] of the given percentile (upper bound of its histogram bin)
+static double percentile(const SimDirection * const dir, const double p)
+{
+   const unsigned long long rank = (unsigned long long)(p * dir->messages);
+   unsigned long long count = 0;
+   for (unsigned int bin = 0; bin < SIM_HIST_BINS; ++bin)
+   {
+      count += dir->histogram[bin];
+      if (count > rank)
+      {
+         return (bin + 1) * SIM_HIST_BIN_US / 1000.0;
+      }
+   }
+   return dir->latencyMax1us / 1000.0;
+}
+
+
+//returns false, if the channels cannot be opened (pool exhausted)
+static bool setup(SimEndpoint * const endpoint, SimChannel * const channels, SimDirection * const rxDirection)
+{
+   endpoint->setWindowSize(config.windowSize);
+   endpoint->setSelectiveRepeat(config.selectiveRepeat);
+   endpoint->setCumulativeAck(config.cumulativeAck);
+   endpoint->setNegativeAck(config.negativeAck);
+   endpoint->setMaxFramePayload(config.framePayload);
+   endpoint->setSchedulingPolicy(config.roundRobin ? SLAY2_DEFICIT_ROUND_ROBIN : SLAY2_STRICT_PRIORITY);
+   endpoint->setDeferredDelivery(config.deferredDelivery);
+   if (config.impairment.baudrate > 0)
+   {
+      endpoint->setBaudrate(config.impairment.baudrate);
+   }
+   //the TX buffer keeps two messages (rounded up to a power of two by open)
+   const unsigned int txBufferSize = (2 * config.msgSize > SLAY2_FIFO_SIZE) ? (2 * config.msgSize) : SLAY2_FIFO_SIZE;
+   for (unsigned int i = 0; i < config.channels; ++i)
+   {
+      memset(&channels[i], 0, sizeof(channels[i]));
+      channels[i].channel = endpoint->open(i, 1, txBufferSize);
+      if ((channels[i].channel == NULL) || (channels[i].channel->getTxBufferSpace() < 2 * config.msgSize))
+      {
+         return false;
+      }
+      channels[i].channel->setReceiver(&onReceive, &channels[i]);
+      channels[i].channel->setBatchReceiver(config.deferredDelivery ? &onReceiveBatch : NULL, &channels[i]);
+      channels[i].rxDirection = rxDirection;
+   }
+   return true;
+}
+
+
+static void report(const char * const name, const SimDirection * const dir, const Slay2Stats * const stats)
+{
+   const double seconds = config.duration1s;
+   const double lineRate = (config.impairment.baudrate > 0) ? (config.impairment.baudrate / 10.0) : 0.0;
+   cout << name << ": " << fixed << setprecision(0) << (dir->bytes / seconds) << " bytes/s";
+   if (lineRate > 0)
+   {
+      cout << " (" << setprecision(1) << (100.0 * dir->bytes / seconds / lineRate) << "% of the line)";
+   }
+   cout << ", " << dir->messages << " messages" << (dir->corrupt ? " CORRUPT" : "") << endl;
+   if (dir->messages > 0)
+   {
+      cout << "   latency [ms] min/avg/p50/p99/max: " << setprecision(1) << (dir->latencyMin1us / 1000.0) << "/"
+           << (dir->latencySum1us / 1000.0 / dir->messages) << "/" << percentile(dir, 0.5) << "/"
+           << percentile(dir, 0.99) << "/" << (dir->latencyMax1us / 1000.0) << endl;
+   }
+   cout << "   retransmissions: " << stats->retransmissions << ", CRC errors: " << stats->crcErrors
+        << ", out of sequence: " << stats->outOfSequence << ", SYNC resets: " << stats->syncResets
+        << ", delivery drops: " << stats->deliveryDrops << ", decompression errors: " << stats->decompressionErrors
+        << ", RTT [ms] min/avg/max: " << stats->rttMin << "/" << stats->rttAvg << "/" << stats->rttMax << endl;
+}
+
+
+static void usage(const char * const name)
+{
+   cout << "usage: " << name << " [-b baudrate] [-d delay_ms] [-e bit_error_rate] [-l burst_length] [-x drop_rate]"
+        << " [-u duplicate_rate] [-s seed] [-c channels] [-m message_size] [-i interval_ms] [-t duration_s]"
+        << " [-w window] [-f frame_payload] [-r (selective repeat)] [-a (cumulative ACK)] [-k (NAK)]"
+        << " [-q (deficit round robin)] [-y (deferred delivery)]" << endl;
+}
+
+
+int main(int argc, char * argv[])
+{
+   memset(&config, 0, sizeof(config));
+   config.impairment.baudrate = 115200;
+   config.impairment.seed = 1;
+   config.channels = 8;
+   config.msgSize = 64;
+   config.duration1s = 60;
+   config.windowSize = SLAY2_SCHEDULER_FIFO_DEPTH;
+   config.framePayload = SLAY2_FRAME_PAYLOAD;
+   int opt;
+   while ((opt = getopt(argc, argv, "b:d:e:l:x:u:s:c:m:i:t:w:f:rakqyh")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b': config.impairment.baudrate = atoi(optarg); break;
+         case 'd': config.impairment.delay1ms = atoi(optarg); break;
+         case 'e': config.impairment.bitErrorRate = atof(optarg); break;
+         case 'l': config.impairment.burstLength = atoi(optarg); break;
+         case 'x': config.impairment.dropRate = atof(optarg); break;
+         case 'u': config.impairment.duplicateRate = atof(optarg); break;
+         case 's': config.impairment.seed = atoi(optarg); break;
+         case 'c': config.channels = atoi(optarg); break;
+         case 'm': config.msgSize = atoi(optarg); break;
+         case 'i': config.interval1ms = atoi(optarg); break;
+         case 't': config.duration1s = atoi(optarg); break;
+         case 'w': config.windowSize = atoi(optarg); break;
+         case 'f': config.framePayload = atoi(optarg); break;
+         case 'r': config.selectiveRepeat = true; break;
+         case 'a': config.cumulativeAck = true; break;
+         case 'k': config.negativeAck = true; break;
+         case 'q': config.roundRobin = true; break;
+         case 'y': config.deferredDelivery = true; break;
+         default: usage(argv[0]); return -1;
+      }
+   }
+   if ((config.impairment.baudrate == 0) || (config.channels < 1) || (config.channels > SLAY2_NUM_CHANNELS) ||
+       (config.msgSize < SIM_MSG_HEADER) || (config.msgSize > SIM_MSG_MAX) || (config.duration1s == 0))
+   {
+      usage(argv[0]);
+      return -1;
+   }
+
+   //the lines are large objects -> static
+   static Slay2Line lineAB;
+   static Slay2Line lineBA;
+   static SimDirection dirAB;
+   static SimDirection dirBA;
+   static SimChannel channelsA[SLAY2_NUM_CHANNELS];
+   static SimChannel channelsB[SLAY2_NUM_CHANNELS];
+   Slay2Impairment impairmentBA = config.impairment;
+   impairmentBA.seed = ~config.impairment.seed; //independent errors per direction
+   lineAB.setImpairment(&config.impairment);
+   lineBA.setImpairment(&impairmentBA);
+   SimEndpoint a(&lineAB, &lineBA);
+   SimEndpoint b(&lineBA, &lineAB);
+   if ((setup(&a, channelsA, &dirBA) == false) || (setup(&b, channelsB, &dirAB) == false))
+   {
+      cerr << "the buffers of the channels cannot hold messages of " << config.msgSize << " bytes" << endl;
+      return -1;
+   }
+
+   cout << "slay2 simulation: " << config.impairment.baudrate << " baud, delay " << config.impairment.delay1ms
+        << " ms, BER " << config.impairment.bitErrorRate << " (burst " << config.impairment.burstLength << "), drop "
+        << config.impairment.dropRate << ", duplicate " << config.impairment.duplicateRate << ", "
+        << config.channels << " channels, " << config.msgSize << " bytes/message, interval " << config.interval1ms
+        << " ms, window " << config.windowSize << ", " << config.duration1s << " s" << endl;
+
+   //event loop
+   struct timespec wallStart;
+   struct timespec wallStop;
+   clock_gettime(CLOCK_MONOTONIC, &wallStart);
+   const unsigned long long end1us = SIM_WARMUP_US + 1000000uLL * config.duration1s;
+   unsigned long long events = 0;
+   unsigned int sameTime = 0;
+   simTime1us = 0;
+   while (simTime1us < end1us)
+   {
+      unsigned long long next = end1us;
+      const unsigned long long nextTxA = generateTraffic(channelsA);
+      const unsigned long long nextTxB = generateTraffic(channelsB);
+      a.task();
+      b.task();
+      ++events;
+      //next event
+      next = (nextTxA < next) ? nextTxA : next;
+      next = (nextTxB < next) ? nextTxB : next;
+      const unsigned long long arrivalA = lineBA.getNextArrival1us(true);
+      const unsigned long long arrivalB = lineAB.getNextArrival1us(true);
+      next = (arrivalA < next) ? arrivalA : next;
+      next = (arrivalB < next) ? arrivalB : next;
+      const unsigned int idleA = a.getIdleTime();
+      const unsigned int idleB = b.getIdleTime();
+      const unsigned long long time1ms = simTime1us / 1000u; //the endpoints count in milliseconds
+      if ((idleA != SLAY2_NO_DEADLINE) && ((1000uLL * (time1ms + idleA)) < next))
+      {
+         next = 1000uLL * (time1ms + idleA);
+      }
+      if ((idleB != SLAY2_NO_DEADLINE) && ((1000uLL * (time1ms + idleB)) < next))
+      {
+         next = 1000uLL * (time1ms + idleB);
+      }
+      //there may be several frames to be transmitted at the same time. but not endlessly
+      if (next <= simTime1us)
+      {
+         next = (++sameTime < SIM_MAX_SAME_TIME) ? simTime1us : (1000uLL * (time1ms + 1));
+      }
+      else
+      {
+         sameTime = 0;
+      }
+      simTime1us = next;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &wallStop);
+   const double wall = (wallStop.tv_sec - wallStart.tv_sec) + (wallStop.tv_nsec - wallStart.tv_nsec) / 1.0e9;
+
+   Slay2Stats statsA;
+   Slay2Stats statsB;
+   a.getStats(&statsA);
+   b.getStats(&statsB);
+   report("A->B", &dirAB, &statsA);
+   report("B->A", &dirBA, &statsB);
+   cout << "simulated " << config.duration1s << " s in " << setprecision(2) << wall << " s (" << events << " events)"
+        << endl;
+   return (dirAB.corrupt || dirBA.corrupt) ? -1 : 0;
+}
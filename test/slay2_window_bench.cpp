@@ -0,0 +1,180 @@
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include "slay2.h"
+
+using namespace std;
+
+/*
+   Benchmark of the goodput as a function of the transmission window size and the round trip time.
+
+   Two slay2 endpoints are interconnected by a simulated serial line (one wire per direction).
+   The wire transmits one byte per "byte time" (10 bits per byte, 8N1) and delivers it after
+   the configured propagation delay. Time is virtual: it is advanced in steps of BENCH_STEP_US,
+   so the result does not depend on the speed of the host.
+   Endpoint A continuously sends on channel 0, endpoint B counts the received bytes.
+*/
+
+#define BENCH_STEP_US      (100u)       //resolution of the virtual clock
+#define BENCH_WARMUP_US    (200000u)    //time for synchronisation, before measuring starts
+#define BENCH_DURATION_US  (10000000u)  //10 seconds of virtual link time
+#define BENCH_UART_FIFO    (4096u)      //size of the (simulated) UART/driver TX buffer
+
+
+static unsigned long long timeUs; //virtual time
+static unsigned int baudrate;
+
+
+
+class BenchWire
+{
+public:
+   BenchWire(const unsigned int delayUs) : delayUs(delayUs), busyUntil(0) { }
+
+   unsigned int getTxCount(void) //number of bytes, not yet on the line
+   {
+      unsigned int count = 0;
+      for (deque<Byte>::reverse_iterator it = fifo.rbegin(); (it != fifo.rend()) && (it->departure > timeUs); ++it)
+      {
+         ++count;
+      }
+      return count;
+   }
+
+   int transmit(const unsigned char * data, unsigned int len)
+   {
+      const unsigned int byteTimeUs = (10u * 1000000u) / baudrate;
+      unsigned int count;
+      for (count = 0; (count < len) && (fifo.size() < BENCH_UART_FIFO); ++count)
+      {
+         Byte b;
+         busyUntil = ((busyUntil > timeUs) ? busyUntil : timeUs) + byteTimeUs;
+         b.departure = busyUntil;
+         b.arrival = busyUntil + delayUs;
+         b.c = data[count];
+         fifo.push_back(b);
+      }
+      return (int)count;
+   }
+
+   int receive(unsigned char * buffer, unsigned int size)
+   {
+      unsigned int count = 0;
+      while ((count < size) && !fifo.empty() && (fifo.front().arrival <= timeUs))
+      {
+         buffer[count++] = fifo.front().c;
+         fifo.pop_front();
+      }
+      return (int)count;
+   }
+
+private:
+   struct Byte
+   {
+      unsigned long long departure;
+      unsigned long long arrival;
+      unsigned char c;
+   };
+   deque<Byte> fifo;
+   unsigned int delayUs;
+   unsigned long long busyUntil;
+};
+
+
+
+class BenchEndpoint : public Slay2
+{
+public:
+   BenchEndpoint(BenchWire * tx, BenchWire * rx) : tx(tx), rx(rx) { }
+
+   unsigned int getTime1ms(void) { return (unsigned int)(timeUs / 1000u); }
+   void enterCritical(void) { }
+   void leaveCritical(void) { }
+
+protected:
+   unsigned int getTxCount(void) { return tx->getTxCount(); }
+   int transmit(const unsigned char * data, unsigned int len) { return tx->transmit(data, len); }
+   int receive(unsigned char * buffer, unsigned int size) { return rx->receive(buffer, size); }
+
+private:
+   BenchWire * tx;
+   BenchWire * rx;
+};
+
+
+
+static void on_receive(void * const obj, const unsigned char * const data, const unsigned int len)
+{
+   *(unsigned long long *)obj += len;
+}
+
+
+//return goodput in bytes per second
+static double measure(const unsigned int windowSize, const unsigned int rttUs)
+{
+   static unsigned char payload[SLAY2_FIFO_SIZE];
+   BenchWire wireAB(rttUs / 2);
+   BenchWire wireBA(rttUs / 2);
+   BenchEndpoint a(&wireAB, &wireBA);
+   BenchEndpoint b(&wireBA, &wireAB);
+   unsigned long long rxBytes = 0;
+
+   timeUs = 0;
+   a.setWindowSize(windowSize);
+   b.setWindowSize(windowSize);
+   a.setBaudrate(baudrate);
+   b.setBaudrate(baudrate);
+   Slay2Channel * const tx = a.open(0);
+   Slay2Channel * const rx = b.open(0);
+   rx->setReceiver(&on_receive, &rxBytes);
+
+   unsigned long long rxStart = 0;
+   while (timeUs < (BENCH_WARMUP_US + BENCH_DURATION_US))
+   {
+      if (timeUs == BENCH_WARMUP_US)
+      {
+         rxStart = rxBytes;
+      }
+      if (timeUs >= BENCH_WARMUP_US)
+      {
+         tx->send(payload, tx->getTxBufferSpace(), true); //keep the channel busy
+      }
+      a.task();
+      b.task();
+      timeUs += BENCH_STEP_US;
+   }
+   return (double)(rxBytes - rxStart) / (BENCH_DURATION_US / 1.0e6);
+}
+
+
+int main(int argc, char * argv[])
+{
+   static const unsigned int baudrates[] = { 115200, 921600 };
+   static const unsigned int windows[] = { 1, 2, 3, 4, 8, 16, 32, 64, 127 };
+   static const unsigned int rtts[] = { 0, 5000, 10000, 20000, 40000 }; //round trip time (propagation delay only) in us
+
+   for (unsigned int b = 0; b < sizeof(baudrates) / sizeof(baudrates[0]); ++b)
+   {
+      baudrate = baudrates[b];
+      const double lineRate = baudrate / 10.0; //bytes per second
+      cout << "Goodput [% of " << baudrate << " baud, 8N1] by window size and round trip time" << endl;
+      cout << setw(8) << "window";
+      for (unsigned int r = 0; r < sizeof(rtts) / sizeof(rtts[0]); ++r)
+      {
+         cout << setw(10) << (rtts[r] / 1000) << "ms";
+      }
+      cout << endl;
+      for (unsigned int w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w)
+      {
+         cout << setw(8) << windows[w];
+         for (unsigned int r = 0; r < sizeof(rtts) / sizeof(rtts[0]); ++r)
+         {
+            const double goodput = measure(windows[w], rtts[r]);
+            cout << setw(12) << fixed << setprecision(1) << (100.0 * goodput / lineRate);
+         }
+         cout << endl;
+      }
+      cout << endl;
+   }
+   return 0;
+}